@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "yas.h"
+
+#define ERROR_RETURN -1
+#define SUCCESS 0
+
+int main(int argc, char **argv) {
+
+    FILE *sourceFile, *outputFile;
+    char *source;
+    long sourceSize;
+    unsigned char *image;
+    size_t imageSize;
+    char error[256];
+
+    // Verify that the command line has an appropriate number
+    // of arguments
+
+    if (argc != 3) {
+        printf("Usage: %s InputFilename OutputFilename\n", argv[0]);
+        return ERROR_RETURN;
+    }
+
+    sourceFile = fopen(argv[1], "rb");
+
+    if (sourceFile == NULL) {
+        printf("Failed to open %s: %s\n", argv[1], strerror(errno));
+        return ERROR_RETURN;
+    }
+
+    fseek(sourceFile, 0, SEEK_END);
+    sourceSize = ftell(sourceFile);
+    fseek(sourceFile, 0, SEEK_SET);
+    source = malloc(sourceSize + 1);
+    if (sourceSize < 0 || source == NULL
+        || fread(source, 1, sourceSize, sourceFile) != (size_t) sourceSize) {
+        printf("Failed to read %s\n", argv[1]);
+        free(source);
+        fclose(sourceFile);
+        return ERROR_RETURN;
+    }
+    fclose(sourceFile);
+
+    if (yasAssemble(source, sourceSize, &image, &imageSize, error, sizeof(error)) != YAS_OK) {
+        printf("%s: %s\n", argv[1], error);
+        free(source);
+        return ERROR_RETURN;
+    }
+    free(source);
+
+    outputFile = fopen(argv[2], "wb");
+
+    if (outputFile == NULL) {
+        printf("Failed to open %s: %s\n", argv[2], strerror(errno));
+        free(image);
+        return ERROR_RETURN;
+    }
+
+    if (fwrite(image, 1, imageSize, outputFile) != imageSize || fclose(outputFile) != 0) {
+        printf("Failed to write %s\n", argv[2]);
+        free(image);
+        return ERROR_RETURN;
+    }
+
+    free(image);
+    return SUCCESS;
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include "cache.h"
+
+#define ERROR_RETURN -1
+#define SUCCESS 0
+
+#define INVALID_TAG UINT64_MAX
+
+static int isPowerOfTwo(unsigned n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+static unsigned log2Of(unsigned n) {
+    unsigned bits = 0;
+
+    while ((1u << bits) < n) {
+        bits++;
+    }
+    return bits;
+}
+
+/* Parses a cache level description of the form
+ * size,ways,lineSize[,lru|plru] where size may carry a k or m suffix.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if the description is malformed or
+ * a field is 0 or does not fit in an unsigned.
+ */
+int parseCacheConfig(const char *spec, struct CacheConfig *config) {
+    char *end;
+    unsigned long v[3];
+
+    for (int i = 0; i < 3; i++) {
+        unsigned long scale = 1;
+
+        errno = 0;
+        v[i] = strtoul(spec, &end, 0);
+        if (end == spec || errno != 0 || *spec == '-') {
+            return ERROR_RETURN;
+        }
+        if (i == 0 && (*end == 'k' || *end == 'K')) {
+            scale = 1024;
+            end++;
+        } else if (i == 0 && (*end == 'm' || *end == 'M')) {
+            scale = 1024 * 1024;
+            end++;
+        }
+        // A size of 0 would disable the level, so it is never valid here
+        if (v[i] == 0 || v[i] > UINT_MAX / scale) {
+            return ERROR_RETURN;
+        }
+        v[i] *= scale;
+        if (i < 2 && *end != ',') {
+            return ERROR_RETURN;
+        }
+        spec = end + 1;
+    }
+
+    config->size = v[0];
+    config->ways = v[1];
+    config->lineSize = v[2];
+    config->policy = CACHE_LRU;
+    if (*end == ',') {
+        if (strcmp(end + 1, "plru") == 0) {
+            config->policy = CACHE_PLRU;
+        } else if (strcmp(end + 1, "lru") != 0) {
+            return ERROR_RETURN;
+        }
+    } else if (*end != '\0') {
+        return ERROR_RETURN;
+    }
+    return SUCCESS;
+}
+
+static int levelInit(struct CacheLevel *level, const struct CacheConfig *config) {
+    unsigned lines;
+
+    memset(level, 0, sizeof(*level));
+    if (config == NULL || config->size == 0) {
+        return SUCCESS;
+    }
+    if (!isPowerOfTwo(config->size) || !isPowerOfTwo(config->lineSize)
+        || !isPowerOfTwo(config->ways) || config->ways > 64
+        || config->size / config->ways < config->lineSize) {
+        return ERROR_RETURN;
+    }
+
+    level->config = *config;
+    level->sets = config->size / (config->ways * config->lineSize);
+    level->lineBits = log2Of(config->lineSize);
+    lines = level->sets * config->ways;
+    level->tags = malloc(lines * sizeof(uint64_t));
+    level->stamps = calloc(lines, sizeof(uint64_t));
+    level->plru = calloc(level->sets, sizeof(uint64_t));
+    if (level->tags == NULL || level->stamps == NULL || level->plru == NULL) {
+        return ERROR_RETURN;
+    }
+    for (unsigned i = 0; i < lines; i++) {
+        level->tags[i] = INVALID_TAG;
+    }
+    return SUCCESS;
+}
+
+// Points every tree-PLRU node on the path to way away from it
+static void plruTouch(struct CacheLevel *level, unsigned set, unsigned way) {
+    unsigned levels = log2Of(level->config.ways);
+    unsigned node = 1;
+
+    for (unsigned l = 0; l < levels; l++) {
+        unsigned bit = (way >> (levels - 1 - l)) & 1;
+        if (bit) {
+            level->plru[set] &= ~((uint64_t) 1 << node);
+        } else {
+            level->plru[set] |= (uint64_t) 1 << node;
+        }
+        node = node * 2 + bit;
+    }
+}
+
+static unsigned plruVictim(struct CacheLevel *level, unsigned set) {
+    unsigned levels = log2Of(level->config.ways);
+    unsigned node = 1;
+    unsigned way = 0;
+
+    for (unsigned l = 0; l < levels; l++) {
+        unsigned bit = (level->plru[set] >> node) & 1;
+        way = way * 2 + bit;
+        node = node * 2 + bit;
+    }
+    return way;
+}
+
+/* Looks up the line holding addr, filling it on a miss.
+ *
+ * Returns 1 on a hit and 0 on a miss.
+ */
+static int levelAccess(struct CacheLevel *level, uint64_t addr) {
+    uint64_t line = addr >> level->lineBits;
+    unsigned set = line & (level->sets - 1);
+    unsigned ways = level->config.ways;
+    uint64_t *tags = level->tags + (size_t) set * ways;
+    uint64_t *stamps = level->stamps + (size_t) set * ways;
+    unsigned victim = 0;
+    int hit = 0;
+
+    level->clock++;
+    for (unsigned w = 0; w < ways; w++) {
+        if (tags[w] == line) {
+            victim = w;
+            hit = 1;
+            break;
+        }
+    }
+
+    if (!hit) {
+        if (level->config.policy == CACHE_PLRU) {
+            victim = plruVictim(level, set);
+        }
+        for (unsigned w = 0; w < ways; w++) {
+            if (tags[w] == INVALID_TAG) {
+                victim = w;
+                break;
+            }
+            if (level->config.policy == CACHE_LRU && stamps[w] < stamps[victim]) {
+                victim = w;
+            }
+        }
+        tags[victim] = line;
+    }
+
+    stamps[victim] = level->clock;
+    if (level->config.policy == CACHE_PLRU) {
+        plruTouch(level, set, victim);
+    }
+    if (hit) {
+        level->hits++;
+    } else {
+        level->misses++;
+    }
+    return hit;
+}
+
+/* Sets up an L1 cache and an optional L2 cache (l2 may be NULL or
+ * have a size of 0). L1 misses are looked up in L2 one L1 line at a
+ * time, so L2 lines may not be smaller than L1 lines.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if a configuration is invalid.
+ */
+int cacheInit(struct Cache *cache, const struct CacheConfig *l1, const struct CacheConfig *l2) {
+    memset(cache, 0, sizeof(*cache));
+    pcTableInit(&cache->pcStats, sizeof(struct CachePCStats));
+    if (l1 == NULL || l1->size == 0) {
+        return ERROR_RETURN;
+    }
+    if (l2 != NULL && l2->size != 0 && l2->lineSize < l1->lineSize) {
+        return ERROR_RETURN;
+    }
+    if (levelInit(&cache->l1, l1) != SUCCESS || levelInit(&cache->l2, l2) != SUCCESS) {
+        cacheFree(cache);
+        return ERROR_RETURN;
+    }
+    return SUCCESS;
+}
+
+/* Models an 8 byte access to addr made by the instruction at pc. The
+ * caches are write-allocate, so stores fill lines just like loads.
+ */
+void cacheAccess(struct Cache *cache, uint64_t pc, uint64_t addr, int isWrite) {
+    struct CachePCStats *stats = pcTableFind(&cache->pcStats, pc);
+    uint64_t first = addr >> cache->l1.lineBits;
+    uint64_t last = (addr + 7) >> cache->l1.lineBits;
+
+    for (uint64_t line = first; line <= last; line++) {
+        uint64_t lineAddr = line << cache->l1.lineBits;
+        int l1Hit = levelAccess(&cache->l1, lineAddr);
+        int l2Hit = l1Hit || cache->l2.sets == 0 || levelAccess(&cache->l2, lineAddr);
+
+        if (stats != NULL) {
+            stats->accesses++;
+            stats->writes += isWrite != 0;
+            stats->l1Misses += !l1Hit;
+            stats->l2Misses += !l2Hit;
+        }
+    }
+}
+
+/* Prints the overall hit rates of each level followed by one line for
+ * every PC that touched memory, in address order.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if there were write problems.
+ */
+int cachePrintStats(FILE *out, struct Cache *cache) {
+    struct CachePCStats *sorted;
+    size_t n;
+    int res;
+
+    res = fprintf(out, "L1 %u bytes, %u-way, %u byte lines, %s: %llu hits, %llu misses (%.2f%% miss)\n",
+                  cache->l1.config.size, cache->l1.config.ways, cache->l1.config.lineSize,
+                  cache->l1.config.policy == CACHE_PLRU ? "plru" : "lru",
+                  (unsigned long long) cache->l1.hits, (unsigned long long) cache->l1.misses,
+                  percent(cache->l1.misses, cache->l1.hits + cache->l1.misses));
+    if (res <= 0) return ERROR_RETURN;
+
+    if (cache->l2.sets != 0) {
+        res = fprintf(out, "L2 %u bytes, %u-way, %u byte lines, %s: %llu hits, %llu misses (%.2f%% miss)\n",
+                      cache->l2.config.size, cache->l2.config.ways, cache->l2.config.lineSize,
+                      cache->l2.config.policy == CACHE_PLRU ? "plru" : "lru",
+                      (unsigned long long) cache->l2.hits, (unsigned long long) cache->l2.misses,
+                      percent(cache->l2.misses, cache->l2.hits + cache->l2.misses));
+        if (res <= 0) return ERROR_RETURN;
+    }
+
+    sorted = pcTableSorted(&cache->pcStats, &n);
+    if (sorted == NULL) {
+        return ERROR_RETURN;
+    }
+
+    res = fprintf(out, "%-18s %10s %10s %10s %8s %10s %8s\n",
+                  "PC", "accesses", "writes", "L1 misses", "L1 miss%", "L2 misses", "L2 miss%");
+    for (size_t i = 0; i < n && res > 0; i++) {
+        uint64_t l2Accesses = sorted[i].l1Misses;
+
+        res = fprintf(out, "%016llx:  %10llu %10llu %10llu %7.2f%% %10llu %7.2f%%\n",
+                      (unsigned long long) sorted[i].pc,
+                      (unsigned long long) sorted[i].accesses,
+                      (unsigned long long) sorted[i].writes,
+                      (unsigned long long) sorted[i].l1Misses,
+                      percent(sorted[i].l1Misses, sorted[i].accesses),
+                      (unsigned long long) sorted[i].l2Misses,
+                      percent(sorted[i].l2Misses, l2Accesses));
+    }
+    free(sorted);
+    return res > 0 ? SUCCESS : ERROR_RETURN;
+}
+
+static void levelFree(struct CacheLevel *level) {
+    free(level->tags);
+    free(level->stamps);
+    free(level->plru);
+    memset(level, 0, sizeof(*level));
+}
+
+void cacheFree(struct Cache *cache) {
+    levelFree(&cache->l1);
+    levelFree(&cache->l2);
+    pcTableFree(&cache->pcStats);
+}
@@ -0,0 +1,54 @@
+/* This file contains the prototypes and constants needed to use the
+   set-associative cache model defined in cache.c
+*/
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pctable.h"
+
+#define CACHE_LRU 0
+#define CACHE_PLRU 1
+
+struct CacheConfig {
+    unsigned size;          // Total capacity in bytes, 0 disables the level
+    unsigned ways;
+    unsigned lineSize;
+    int policy;             // CACHE_LRU or CACHE_PLRU
+};
+
+struct CacheLevel {
+    struct CacheConfig config;
+    unsigned sets;
+    unsigned lineBits;
+    uint64_t *tags;         // sets * ways tags, UINT64_MAX when invalid
+    uint64_t *stamps;       // LRU: last use of each way
+    uint64_t *plru;         // PLRU: ways - 1 tree bits per set
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+struct CachePCStats {
+    uint64_t pc;
+    uint64_t accesses;
+    uint64_t writes;
+    uint64_t l1Misses;
+    uint64_t l2Misses;
+};
+
+struct Cache {
+    struct CacheLevel l1;
+    struct CacheLevel l2;
+    struct PCTable pcStats;         // Of struct CachePCStats
+};
+
+int parseCacheConfig(const char *spec, struct CacheConfig *config);
+int cacheInit(struct Cache *cache, const struct CacheConfig *l1, const struct CacheConfig *l2);
+void cacheAccess(struct Cache *cache, uint64_t pc, uint64_t addr, int isWrite);
+int cachePrintStats(FILE *out, struct Cache *cache);
+void cacheFree(struct Cache *cache);
+
+#endif /* CACHE */
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -8,153 +10,264 @@
 #include <errno.h>
 #include <string.h>
 #include "printRoutines.h"
+#include "yas.h"
 
 #define ERROR_RETURN -1
 #define SUCCESS 0
 
-#define I_HALT 0x0
-#define I_NOP 0x1
-#define I_RRMOVQ 0x2
-#define I_IRMOVQ 0x3
-#define I_RMMOVQ 0x4
-#define I_MRMOVQ 0x5
-#define I_OPQ 0x6
-#define I_JXX 0x7
-#define I_CALL 0x8
-#define I_RET 0x9
-#define I_PUSHQ 0xa
-#define I_POPQ 0xb
-
-#define A_ADDQ 0x0
-#define A_SUBQ 0x1
-#define A_ANDQ 0x2
-#define A_XORQ 0x3
-#define A_MULQ 0x4
-#define A_DIVQ 0x5
-#define A_MODQ 0x6
-
-#define C_NC 0x0
-#define C_LE 0x1
-#define C_L 0x2
-#define C_E 0x3
-#define C_NE 0x4
-#define C_GE 0x5
-#define C_G 0x6
-
-char *getRegister(char r);
-struct Instr readInstr(FILE *machineCode, long addr);
-typedef enum { false, true } bool;
-
-bool error = false;
-bool endFile = false;
-
-struct Instr {
-    long addr;
-    char fullHex[100];
-    char name[100];
-    char op1[100];
-    char op2[100];
-};
-
-int printInstr(FILE *out, struct Instr instr) {
-
-    if (!error) {
-        printf("%016lx: ", instr.addr);
-
-        for (int i=0; i<20; i++) {
-            if (instr.fullHex[i] == '\0') {
-                printf(" ");
-            } else {
-                printf("%c", instr.fullHex[i]);
+#define RING_SIZE 4096
+
+/* Disassembles the bytes read from fd as they arrive, writing one
+ * listing line per instruction to out. The first skip bytes are
+ * dropped and the next one is taken to be at address addr. Input is
+ * staged in a fixed ring buffer, so memory use does not depend on the
+ * size of the image and fd may be a pipe or socket.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if there were read or write problems.
+ */
+int streamCode(FILE *out, int fd, long skip, long addr) {
+    unsigned char ring[RING_SIZE];
+    unsigned char scratch[YAS_MAX_LENGTH];
+    struct YasInstr instr;
+    char line[YAS_LINE_SIZE];
+    size_t head = 0;        // Total bytes read
+    size_t tail = 0;        // Total bytes consumed
+    int eof = 0;
+
+    while (!eof || head != tail) {
+        if (!eof) {
+            size_t start = head % RING_SIZE;
+            size_t room = RING_SIZE - (head - tail);
+            ssize_t n;
+
+            if (room > RING_SIZE - start) {
+                room = RING_SIZE - start;
+            }
+            n = read(fd, ring + start, room);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return ERROR_RETURN;
             }
+            if (n == 0) {
+                eof = 1;
+            }
+            head += n;
         }
 
-        printf("  %s", instr.name);
-        if  (strlen(instr.op1) != 0) {
-            printf(" %s", instr.op1);
-        } 
-        if (strlen(instr.op2) != 0) {
-            printf(", %s", instr.op2);
+        while (skip > 0 && head != tail) {
+            size_t drop = head - tail < (size_t) skip ? head - tail : (size_t) skip;
+            tail += drop;
+            skip -= drop;
+        }
+
+        while (head != tail) {
+            size_t avail = head - tail;
+            size_t start = tail % RING_SIZE;
+            const unsigned char *code = ring + start;
+            size_t len = RING_SIZE - start < avail ? RING_SIZE - start : avail;
+
+            // Instructions that wrap around the end of the ring are
+            // decoded from a contiguous copy
+            if (len < YAS_MAX_LENGTH && len < avail) {
+                len = avail < YAS_MAX_LENGTH ? avail : YAS_MAX_LENGTH;
+                for (size_t i = 0; i < len; i++) {
+                    scratch[i] = ring[(tail + i) % RING_SIZE];
+                }
+                code = scratch;
+            }
+
+            if (yasDecode(code, len, addr, &instr) == YAS_TRUNCATED) {
+                if (!eof) {
+                    break;
+                }
+                // Show the leftover bytes one at a time
+                instr.addr = addr;
+                instr.bytes[0] = code[0];
+                instr.length = 1;
+                instr.valid = 0;
+            }
+            yasFormat(&instr, line, sizeof(line));
+            if (fprintf(out, "%s\n", line) <= 0) {
+                return ERROR_RETURN;
+            }
+            tail += instr.length;
+            addr += instr.length;
+        }
+
+        if (fflush(out) != 0) {
+            return ERROR_RETURN;
         }
-        printf("\n");
-        return SUCCESS;
-    } else {
-        return ERROR_RETURN;
     }
+    return SUCCESS;
 }
 
-char *getRegister(char r) {
-    char *ret = malloc(6);
-    switch(r) {
-        case 0x0:
-            strcpy(ret, "%rax");
-            break;
-        case 0x1:
-            strcpy(ret, "%rcx");
-            break;
-        case 0x2:
-            strcpy(ret, "%rdx");
-            break;
-        case 0x3:
-            strcpy(ret, "%rbx");
-            break;	
-        case 0x4:
-            strcpy(ret, "%rsp");
-            break;
-        case 0x5:
-            strcpy(ret, "%rbp");
-            break;
-        case 0x6:
-            strcpy(ret, "%rsi");
-            break;
-        case 0x7:
-            strcpy(ret, "%rdi");
-            break;
-        case 0x8:
-            strcpy(ret, "%r8");
-            break;
-        case 0x9:
-            strcpy(ret, "%r9");
-            break;
-        case 0xa:
-            strcpy(ret, "%r10");
-            break;
-        case 0xb:
-            strcpy(ret, "%r11");
-            break;
-        case 0xc:
-            strcpy(ret, "%r12");
-            break;
-        case 0xd:
-            strcpy(ret, "%r13");
+#define COMMENT_COLUMN 64
+
+/* Reads all of fd after dropping the first skip bytes, then writes a
+ * listing annotated with register dataflow: the registers live into
+ * each basic block, writes nothing reads afterwards (dead) and reads no
+ * write reaches (undefined). Unlike streamCode() this needs the whole
+ * image in memory, since the analysis looks at every path through it.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if there were read, write or
+ * memory problems.
+ */
+int annotateCode(FILE *out, int fd, long skip, long addr) {
+    unsigned char *code = NULL;
+    size_t len = 0;
+    size_t capacity = 0;
+    struct YasInstr *instrs = NULL;
+    struct YasFlow *flow = NULL;
+    unsigned char *targeted = NULL;
+    int entry;
+    size_t n;
+    size_t used;
+    char line[YAS_LINE_SIZE];
+    char regs[YAS_LINE_SIZE];
+    int res = ERROR_RETURN;
+
+    for (;;) {
+        ssize_t got;
+
+        if (len == capacity) {
+            unsigned char *bigger = realloc(code, capacity ? capacity * 2 : RING_SIZE);
+            if (bigger == NULL) {
+                goto done;
+            }
+            code = bigger;
+            capacity = capacity ? capacity * 2 : RING_SIZE;
+        }
+        got = read(fd, code + len, capacity - len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            goto done;
+        }
+        if (got == 0) {
             break;
-        case 0xe:
-            strcpy(ret, "%r14");
+        }
+        len += got;
+    }
+    if ((size_t) skip >= len) {
+        res = SUCCESS;
+        goto done;
+    }
+
+    // Count the instructions first, so the arrays are sized by the
+    // code rather than by the number of bytes
+    n = 0;
+    for (size_t offset = skip; offset < len; n++) {
+        struct YasInstr instr;
+
+        if (yasDecode(code + offset, len - offset, addr + (offset - skip), &instr) == YAS_TRUNCATED) {
+            // The leftover bytes are shown one at a time
+            n += len - offset;
             break;
-        default:
-            error = true;
-            strcpy(ret, "error");
+        }
+        offset += instr.length;
+    }
+    instrs = malloc(n * sizeof(struct YasInstr));
+    flow = malloc(n * sizeof(struct YasFlow));
+    if (instrs == NULL || flow == NULL) {
+        goto done;
+    }
+    n = yasDecodeBuffer(code + skip, len - skip, addr, instrs, n, &used);
+    // Show the leftover bytes one at a time
+    for (; used < len - skip; used++, n++) {
+        memset(&instrs[n], 0, sizeof(instrs[n]));
+        instrs[n].addr = addr + used;
+        instrs[n].bytes[0] = code[skip + used];
+        instrs[n].length = 1;
+    }
+    if (yasAnalyze(instrs, n, flow) != YAS_OK) {
+        goto done;
+    }
+    targeted = calloc(n, 1);
+    if (targeted == NULL) {
+        goto done;
     }
-    return ret;
+    for (size_t i = 0; i < n; i++) {
+        if (flow[i].target != (size_t) -1) {
+            targeted[flow[i].target] = 1;
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        int width = yasFormat(&instrs[i], line, sizeof(line));
+
+        if (fputs(line, out) == EOF) {
+            goto done;
+        }
+        // Live-in sets are only shown where control can arrive from
+        // elsewhere: the start and jump or call targets
+        entry = i == 0 || targeted[i];
+        if (entry || flow[i].dead || flow[i].undefined) {
+            const char *sep = "";
+
+            fprintf(out, "%*s#", width < COMMENT_COLUMN ? COMMENT_COLUMN - width : 1, "");
+            if (entry) {
+                yasFormatMask(flow[i].liveIn, regs, sizeof(regs));
+                fprintf(out, " live-in: %s", regs[0] ? regs : "none");
+                sep = ";";
+            }
+            if (flow[i].dead) {
+                yasFormatMask(flow[i].dead, regs, sizeof(regs));
+                fprintf(out, "%s dead: %s", sep, regs);
+                sep = ";";
+            }
+            if (flow[i].undefined) {
+                yasFormatMask(flow[i].undefined, regs, sizeof(regs));
+                fprintf(out, "%s undefined: %s", sep, regs);
+            }
+        }
+        if (putc('\n', out) == EOF) {
+            goto done;
+        }
+    }
+    res = SUCCESS;
+
+done:
+    free(code);
+    free(instrs);
+    free(flow);
+    free(targeted);
+    return res;
 }
 
 int main(int argc, char **argv) {
 
     FILE *machineCode, *outputFile;
     long currAddr = 0;
-    struct Instr currInstr;
+    int annotate = 0;
+    int res;
+
+    // An optional -a asks for the dataflow annotated listing
+    if (argc > 1 && strcmp(argv[1], "-a") == 0) {
+        annotate = 1;
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
 
     // Verify that the command line has an appropriate number
     // of arguments
 
     if (argc < 3 || argc > 4) {
-        printf("Usage: %s InputFilename OutputFilename [startingOffset]\n", argv[0]);
+        printf("Usage: %s [-a] InputFilename|- OutputFilename|- [startingOffset]\n", argv[0]);
         return ERROR_RETURN;
     }
 
     // First argument is the file to read, attempt to open it 
-    // for reading and verify that the open did occur.
-    machineCode = fopen(argv[1], "rb");
+    // for reading and verify that the open did occur. A name of
+    // "-" streams the machine code from standard input.
+    if (strcmp(argv[1], "-") == 0) {
+        machineCode = stdin;
+    } else {
+        machineCode = fopen(argv[1], "rb");
+    }
 
     if (machineCode == NULL) {
         printf("Failed to open %s: %s\n", argv[1], strerror(errno));
@@ -162,8 +275,13 @@ int main(int argc, char **argv) {
     }
 
     // Second argument is the file to write, attempt to open it 
-    // for writing and verify that the open did occur.
-    outputFile = fopen(argv[2], "w");
+    // for writing and verify that the open did occur. A name of
+    // "-" writes the listing to standard output.
+    if (strcmp(argv[2], "-") == 0) {
+        outputFile = stdout;
+    } else {
+        outputFile = fopen(argv[2], "w");
+    }
 
     if (outputFile == NULL) {
         printf("Failed to open %s: %s\n", argv[2], strerror(errno));
@@ -186,361 +304,25 @@ int main(int argc, char **argv) {
         }
     }
 
-    printf("Opened %s, starting offset 0x%lX\n", argv[1], currAddr);
-    printf("Saving output to %s\n", argv[2]);
-
-
-    printInstr(outputFile, readInstr(machineCode, currAddr));
+    // Keep these out of the listing when it goes to stdout
+    fprintf(outputFile == stdout ? stderr : stdout, "Opened %s, starting offset 0x%lX\n", argv[1], currAddr);
+    fprintf(outputFile == stdout ? stderr : stdout, "Saving output to %s\n", argv[2]);
 
 
-    fclose(machineCode);
-    fclose(outputFile);
-    return SUCCESS;
-}
-
-struct Instr readInstr(FILE *machineCode, long addr) {
-    struct Instr currInstr;
-    int currByte;
-    int iCd;
-    int iFn;
-    char rA;
-    char rB;
-    long long valC;
-
-    //Start stream from offset
-    fseek(machineCode, addr, SEEK_SET);
-
-    //Set address of instruction
-    currInstr.addr = addr;
-
-    //Read first byte of instruction
-    //First byte is always iCd/iFn
-    //Always check if end of file
-    if((currByte = fgetc(machineCode)) != EOF) {
-        //currInstr.fullHex[0] = (char) currByte;
-        iCd = currByte >> 4;
-        iFn = currByte & 0xf;
-        sprintf(currInstr.fullHex, "%02X", currByte);
-        memset(currInstr.fullHex+2, '\0', 25);
+    // Files can seek straight to the offset, streams have to read
+    // their way there
+    if (annotate) {
+        res = annotateCode(outputFile, fileno(machineCode), currAddr, currAddr);
+    } else if (machineCode != stdin && fseek(machineCode, currAddr, SEEK_SET) == 0) {
+        res = streamCode(outputFile, fileno(machineCode), 0, currAddr);
     } else {
-        endFile = true;
-        return currInstr;
+        res = streamCode(outputFile, fileno(machineCode), currAddr, currAddr);
+    }
+    if (res != SUCCESS) {
+        fprintf(outputFile == stdout ? stderr : stdout, "Failed while disassembling %s: %s\n", argv[1], strerror(errno));
     }
 
-    //Check if iCd and iFn working. Only halt, nop, and ret are finished here
-    switch(iCd) {
-            //HALT, NOP, and RET only have iFn and iCd so we return regardless of error
-        case I_HALT:
-            strcpy(currInstr.name, "halt");
-            currInstr.op1[0] = '\0';
-            currInstr.op2[0] = '\0';
-            if(iFn != 0x0) {
-                error = true;
-            }
-            return currInstr;
-            break;
-
-        case I_NOP:
-            strcpy(currInstr.name, "nop");
-            currInstr.op1[0] = '\0';
-            currInstr.op2[0] = '\0';
-            if(iFn != 0x0) {
-                error = true;
-            }
-            return currInstr;
-            break;
-
-        case I_RET:
-            strcpy(currInstr.name, "ret");
-            currInstr.op1[0] = '\0';
-            currInstr.op2[0] = '\0';
-            if(iFn != 0x0) {
-                error = true;
-            }
-            return currInstr;
-            break;
-
-        case I_RRMOVQ:
-            switch(iFn) {
-                case C_NC:
-                    strcpy(currInstr.name, "rrmovq");
-                    break;
-                case C_LE:
-                    strcpy(currInstr.name, "cmovle");
-                    break;
-                case C_L:
-                    strcpy(currInstr.name, "cmovl");
-                    break;
-                case C_E:
-                    strcpy(currInstr.name, "cmove");
-                    break;
-                case C_NE:
-                    strcpy(currInstr.name, "cmovne");
-                    break;
-                case C_GE:
-                    strcpy(currInstr.name, "cmovge");
-                    break;
-                case C_G:
-                    strcpy(currInstr.name, "cmovg");
-                    break;
-                default:
-                    error = true;
-                    return currInstr;
-            }
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                rB = currByte & 0xf;
-                strcpy(currInstr.op1, getRegister(rA));
-                strcpy(currInstr.op2, getRegister(rB));
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            break;
-
-        case I_OPQ:
-            switch(iFn) {
-                case A_ADDQ:
-                    strcpy(currInstr.name, "addq");
-                    break;
-                case A_SUBQ:
-                    strcpy(currInstr.name, "subq");
-                    break;
-                case A_ANDQ:
-                    strcpy(currInstr.name, "andq");
-                    break;
-                case A_XORQ:
-                    strcpy(currInstr.name, "xorq");
-                    break;
-                case A_MULQ:
-                    strcpy(currInstr.name, "mulq");
-                    break;
-                case A_DIVQ:
-                    strcpy(currInstr.name, "divq");
-                    break;
-                case A_MODQ:
-                    strcpy(currInstr.name, "modq");
-                    break;
-                default:
-                    error = true;
-                    return currInstr;
-            }
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                rB = currByte & 0xf;
-                strcpy(currInstr.op1, getRegister(rA));
-                strcpy(currInstr.op2, getRegister(rB));
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            break;
-
-        case I_PUSHQ:
-            if(iFn != 0x0) {
-                error = true;
-                return currInstr;
-            }
-
-            strcpy(currInstr.name, "pushq");
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                strcpy(currInstr.op1, getRegister(rA));
-                currInstr.op2[0] = '\0';
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            break;
-
-        case I_POPQ:
-            if(iFn != 0x0) {
-                error = true;
-                return currInstr;
-            }
-            strcpy(currInstr.name, "popq");
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                strcpy(currInstr.op1, getRegister(rA));
-                currInstr.op2[0] = '\0';
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            break;
-
-            //------------------------------------------------------- Finishline
-        case I_IRMOVQ:
-            if(iFn != 0x0) {
-                error = true;
-                return currInstr;
-            }
-            strcpy(currInstr.name, "irmovq");
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                rB = currByte & 0xf;
-                strcpy(currInstr.op2, getRegister(rB));
-                if (rA != 0xf) {
-                    error = true;
-                }
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            for(int i = 0; i < 8; i++) {
-                if((currByte = fgetc(machineCode)) != EOF) {
-                    sprintf(currInstr.fullHex+4+(i*2), "%02X", currByte);
-                    valC += currByte << (i * 8);
-                } else {
-                    endFile = true;
-                    return currInstr;
-                }
-            }
-            sprintf(currInstr.op1, "$0x%llx", valC);
-            break;
-
-        case I_RMMOVQ:
-            if(iFn != 0x0) {
-                error = true;
-                return currInstr;
-            }
-            strcpy(currInstr.name, "rmmovq");
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                rB = currByte & 0xf;
-                strcpy(currInstr.op1, getRegister(rA));
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            for(int i = 0; i < 8; i++) {
-                if((currByte = fgetc(machineCode)) != EOF) {
-                    sprintf(currInstr.fullHex+4+(i*2), "%02X", currByte);
-                    valC += currByte << (i * 8);
-                } else {
-                    endFile = true;
-                    return currInstr;
-                }
-            }
-            sprintf(currInstr.op2, "$0x%llx(%s)", valC, getRegister(rB));
-            break;
-
-        case I_MRMOVQ:
-             if(iFn != 0x0) {
-                error = true;
-                return currInstr;
-            }
-            strcpy(currInstr.name, "mrmovq");
-            if((currByte = fgetc(machineCode)) != EOF) {
-                sprintf(currInstr.fullHex+2, "%02X", currByte);
-                rA = currByte >> 4;
-                rB = currByte & 0xf;
-                strcpy(currInstr.op2, getRegister(rB));
-                if(error == true) {
-                    return currInstr;
-                }
-            } else {
-                endFile = true;
-                return currInstr;
-            }
-            for(int i = 0; i < 8; i++) {
-                if((currByte = fgetc(machineCode)) != EOF) {
-                    sprintf(currInstr.fullHex+4+(i*2), "%02X", currByte);
-                    valC += currByte << (i * 8);
-                } else {
-                    endFile = true;
-                    return currInstr;
-                }
-            }
-            sprintf(currInstr.op1, "$0x%llx(%s)", valC, getRegister(rA));
-            break;
-
-        case I_CALL:
-			if(iFn != 0x0) {
-				error = true;
-				return currInstr;
-			}
-			strcpy(currInstr.name, "call");
-			strcpy(currInstr.op1, "$0x");
-			currInstr.op2[0] = '\0';
-			
-			for(int i = 0; i < 8; i++) {
-				if((currByte = fgetc(machineCode)) != EOF) {
-					sprintf(currInstr.fullHex+2+(i*2), "%02X", currByte);
-					valP += currByte << (i * 8);
-				} else {
-					endFile = true;
-					return currInstr;
-				}
-			}	
-			sprintf(currInstr.op1+3, "%llx", valP);
-            break;
-
-		case I_JXX:
-            switch(iFn) {
-                case C_NC:
-					strcpy(currInstr.name, "j");
-        		    break;
-                case C_LE:
-					strcpy(currInstr.name, "jle");
-					break;
-                case C_L:
-					strcpy(currInstr.name, "jl");
-					break;
-                case C_E:
-					strcpy(currInstr.name, "je");
-					break;
-                case C_NE:
-					strcpy(currInstr.name, "jne");
-					break;
-                case C_GE:
-					strcpy(currInstr.name, "jge");
-					break;
-                case C_G:
-					strcpy(currInstr.name, "jg");
-                    break;
-                default:
-                    error = true;
-                    return currInstr;
-            }
-			strcpy(currInstr.op1, "$0x");
-			currInstr.op2[0] = '\0';
-			
-			for(int i = 0; i < 8; i++) {
-				if((currByte = fgetc(machineCode)) != EOF) {
-					sprintf(currInstr.fullHex+2+(i*2), "%02X", currByte);
-					valP += currByte << (i * 8);
-				} else {
-					endFile = true;
-					return currInstr;
-				}
-			}
-			sprintf(currInstr.op1+3, "%llx", valP);
-			break;
-	}
-    return currInstr;
+    fclose(machineCode);
+    fclose(outputFile);
+    return res;
 }
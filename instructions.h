@@ -0,0 +1,40 @@
+/* This file contains the Y86-64 instruction encodings shared by the
+   disassembler and the simulator.
+*/
+
+#ifndef _INSTRUCTIONS_H_
+#define _INSTRUCTIONS_H_
+
+#define I_HALT 0x0
+#define I_NOP 0x1
+#define I_RRMOVQ 0x2
+#define I_IRMOVQ 0x3
+#define I_RMMOVQ 0x4
+#define I_MRMOVQ 0x5
+#define I_OPQ 0x6
+#define I_JXX 0x7
+#define I_CALL 0x8
+#define I_RET 0x9
+#define I_PUSHQ 0xa
+#define I_POPQ 0xb
+
+#define A_ADDQ 0x0
+#define A_SUBQ 0x1
+#define A_ANDQ 0x2
+#define A_XORQ 0x3
+#define A_MULQ 0x4
+#define A_DIVQ 0x5
+#define A_MODQ 0x6
+
+#define C_NC 0x0
+#define C_LE 0x1
+#define C_L 0x2
+#define C_E 0x3
+#define C_NE 0x4
+#define C_GE 0x5
+#define C_G 0x6
+
+#define R_RSP 0x4
+#define R_NONE 0xf
+
+#endif /* INSTRUCTIONS */
@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "instructions.h"
+#include "machine.h"
+#include "yas.h"
+
+#define ERROR_RETURN -1
+#define SUCCESS 0
+
+static const char *statNames[5] = { "", "AOK", "HLT", "ADR", "INS" };
+
+// Sets up an empty page table covering memSize bytes
+static int allocPages(struct Machine *m, uint64_t memSize) {
+    uint64_t pageCount = (memSize >> PAGE_BITS) + ((memSize & (PAGE_SIZE - 1)) != 0);
+
+    if (pageCount > SIZE_MAX / sizeof(struct Page *)) {
+        return ERROR_RETURN;
+    }
+    m->pageCount = pageCount;
+    m->pages = calloc(m->pageCount, sizeof(struct Page *));
+    m->owned = calloc(m->pageCount, 1);
+    m->dirty = malloc(m->pageCount * sizeof(size_t));
+    m->memSize = memSize;
+    if (m->pages == NULL || m->owned == NULL || m->dirty == NULL) {
+        freeMachine(m);
+        return ERROR_RETURN;
+    }
+    return SUCCESS;
+}
+
+/* Loads the raw image in machineCode at address 0 of a zero filled
+ * memory of memSize bytes (grown to fit the image if needed) and
+ * resets the registers, condition codes and program counter.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if memory could not be allocated.
+ */
+int loadMachine(struct Machine *m, FILE *machineCode, uint64_t memSize, uint64_t pc) {
+    long imageSize;
+
+    fseek(machineCode, 0, SEEK_END);
+    imageSize = ftell(machineCode);
+    fseek(machineCode, 0, SEEK_SET);
+    if (imageSize < 0) {
+        return ERROR_RETURN;
+    }
+    if ((uint64_t) imageSize > memSize) {
+        memSize = imageSize;
+    }
+
+    memset(m, 0, sizeof(*m));
+    if (allocPages(m, memSize) != SUCCESS) {
+        return ERROR_RETURN;
+    }
+    // Pages past the end of the image stay NULL until written
+    for (size_t i = 0; (long) i * PAGE_SIZE < imageSize; i++) {
+        size_t len = imageSize - (long) i * PAGE_SIZE;
+
+        m->pages[i] = calloc(1, sizeof(struct Page));
+        if (m->pages[i] == NULL) {
+            freeMachine(m);
+            return ERROR_RETURN;
+        }
+        m->owned[i] = 1;
+        if (fread(m->pages[i]->data, 1, len < PAGE_SIZE ? len : PAGE_SIZE, machineCode) == 0) {
+            freeMachine(m);
+            return ERROR_RETURN;
+        }
+    }
+    m->pc = pc;
+    m->zf = 1;
+    m->status = STAT_AOK;
+    return SUCCESS;
+}
+
+void freeMachine(struct Machine *m) {
+    // A failed allocPages may leave either array NULL
+    for (size_t i = 0; m->pages != NULL && m->owned != NULL && i < m->pageCount; i++) {
+        if (m->owned[i]) {
+            free(m->pages[i]);
+        }
+    }
+    free(m->pages);
+    free(m->owned);
+    free(m->dirty);
+    m->pages = NULL;
+    m->owned = NULL;
+    m->dirty = NULL;
+    m->pageCount = 0;
+    m->dirtyCount = 0;
+    m->memSize = 0;
+    m->base = NULL;
+}
+
+static int readByte(struct Machine *m, uint64_t addr) {
+    struct Page *page = m->pages[addr >> PAGE_BITS];
+
+    return page == NULL ? 0 : page->data[addr & (PAGE_SIZE - 1)];
+}
+
+/* Returns a page the machine may write in place, copying a page shared
+ * with a snapshot (or allocating a zero page) the first time.
+ */
+static struct Page *writablePage(struct Machine *m, size_t index) {
+    struct Page *shared = m->pages[index];
+    struct Page *page;
+
+    if (m->owned[index]) {
+        return shared;
+    }
+    page = malloc(sizeof(struct Page));
+    if (page == NULL) {
+        return NULL;
+    }
+    if (shared == NULL) {
+        memset(page->data, 0, PAGE_SIZE);
+    } else {
+        memcpy(page->data, shared->data, PAGE_SIZE);
+    }
+    page->refs = 0;
+    m->pages[index] = page;
+    m->owned[index] = 1;
+    m->dirty[m->dirtyCount++] = index;
+    return page;
+}
+
+static int readQuad(struct Machine *m, uint64_t addr, uint64_t *val) {
+    uint64_t v = 0;
+
+    if (addr > m->memSize || m->memSize - addr < 8) {
+        return ERROR_RETURN;
+    }
+    for (int i = 0; i < 8; i++) {
+        v |= (uint64_t) readByte(m, addr + i) << (i * 8);
+    }
+    *val = v;
+    return SUCCESS;
+}
+
+// Only accesses that complete are shown to the cache model
+static int loadQuad(struct Machine *m, uint64_t addr, uint64_t *val) {
+    if (readQuad(m, addr, val) != SUCCESS) {
+        return ERROR_RETURN;
+    }
+    if (m->cache != NULL) {
+        cacheAccess(m->cache, m->pc, addr, 0);
+    }
+    return SUCCESS;
+}
+
+static int storeQuad(struct Machine *m, uint64_t addr, uint64_t val) {
+    if (addr > m->memSize || m->memSize - addr < 8) {
+        return ERROR_RETURN;
+    }
+    for (int i = 0; i < 8; i++) {
+        struct Page *page = writablePage(m, (addr + i) >> PAGE_BITS);
+
+        if (page == NULL) {
+            return ERROR_RETURN;
+        }
+        page->data[(addr + i) & (PAGE_SIZE - 1)] = (unsigned char) (val >> (i * 8));
+    }
+    if (m->cache != NULL) {
+        cacheAccess(m->cache, m->pc, addr, 1);
+    }
+    return SUCCESS;
+}
+
+/* Stores the quad val at addr without going through the cache model,
+ * for setting up inputs before a run.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if addr is outside memory.
+ */
+int writeMachineQuad(struct Machine *m, uint64_t addr, uint64_t val) {
+    struct Cache *cache = m->cache;
+    int res;
+
+    m->cache = NULL;
+    res = storeQuad(m, addr, val);
+    m->cache = cache;
+    return res;
+}
+
+/* Captures the registers, condition codes and memory of m in s. The
+ * pages themselves are shared rather than copied: m gives up write
+ * access to them and copies any page it writes afterwards.
+ *
+ * Snapshots must be taken and freed from one thread, and machines
+ * restored from a snapshot must be freed before it is.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if memory could not be allocated.
+ */
+int takeSnapshot(struct Snapshot *s, struct Machine *m) {
+    s->pages = malloc(m->pageCount * sizeof(struct Page *));
+    if (s->pages == NULL) {
+        return ERROR_RETURN;
+    }
+    for (size_t i = 0; i < m->pageCount; i++) {
+        struct Page *page = m->pages[i];
+
+        if (page != NULL) {
+            page->refs = m->owned[i] ? 1 : page->refs + 1;
+        }
+        m->owned[i] = 0;
+        s->pages[i] = page;
+    }
+    s->pageCount = m->pageCount;
+    s->memSize = m->memSize;
+    memcpy(s->reg, m->reg, sizeof(s->reg));
+    s->zf = m->zf;
+    s->sf = m->sf;
+    s->of = m->of;
+    s->pc = m->pc;
+    s->status = m->status;
+    s->steps = m->steps;
+
+    m->dirtyCount = 0;
+    m->base = s;
+    return SUCCESS;
+}
+
+/* Puts m back in the state captured by s. When m was last restored
+ * from (or snapshotted into) s this only touches the pages m has
+ * written since; otherwise every page is reset. m may also be an all
+ * zero Machine, in which case it is set up from scratch.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if memory could not be allocated.
+ */
+int restoreSnapshot(struct Machine *m, const struct Snapshot *s) {
+    if (m->pageCount != s->pageCount) {
+        struct Cache *cache = m->cache;
+        struct Predictor *predictor = m->predictor;
+
+        freeMachine(m);
+        memset(m, 0, sizeof(*m));
+        if (allocPages(m, s->memSize) != SUCCESS) {
+            return ERROR_RETURN;
+        }
+        m->cache = cache;
+        m->predictor = predictor;
+    }
+
+    if (m->base == s) {
+        for (size_t i = 0; i < m->dirtyCount; i++) {
+            size_t index = m->dirty[i];
+
+            free(m->pages[index]);
+            m->pages[index] = s->pages[index];
+            m->owned[index] = 0;
+        }
+    } else {
+        for (size_t i = 0; i < m->pageCount; i++) {
+            if (m->owned[i]) {
+                free(m->pages[i]);
+            }
+            m->pages[i] = s->pages[i];
+            m->owned[i] = 0;
+        }
+    }
+    m->dirtyCount = 0;
+    m->base = s;
+
+    memcpy(m->reg, s->reg, sizeof(m->reg));
+    m->zf = s->zf;
+    m->sf = s->sf;
+    m->of = s->of;
+    m->pc = s->pc;
+    m->status = s->status;
+    m->steps = s->steps;
+    return SUCCESS;
+}
+
+void freeSnapshot(struct Snapshot *s) {
+    for (size_t i = 0; i < s->pageCount; i++) {
+        if (s->pages[i] != NULL && --s->pages[i]->refs == 0) {
+            free(s->pages[i]);
+        }
+    }
+    free(s->pages);
+    s->pages = NULL;
+    s->pageCount = 0;
+}
+
+static int condHolds(struct Machine *m, int ifun) {
+    switch (ifun) {
+        case C_NC:
+            return 1;
+        case C_LE:
+            return (m->sf ^ m->of) | m->zf;
+        case C_L:
+            return m->sf ^ m->of;
+        case C_E:
+            return m->zf;
+        case C_NE:
+            return !m->zf;
+        case C_GE:
+            return !(m->sf ^ m->of);
+        case C_G:
+            return !(m->sf ^ m->of) && !m->zf;
+    }
+    return 0;
+}
+
+/* Fetches, decodes and executes the instruction at the current PC.
+ *
+ * Returns the machine status after the instruction, which is STAT_AOK
+ * if execution can continue.
+ */
+int stepMachine(struct Machine *m) {
+    struct YasInstr instr;
+    unsigned char fetched[YAS_MAX_LENGTH];
+    unsigned fetchLen;
+    uint64_t pc = m->pc;
+    uint64_t valC, valP;
+    uint64_t valA, valB, valE, valM;
+    int iCd, iFn, rA, rB;
+
+    if (m->status != STAT_AOK) {
+        return m->status;
+    }
+    if (pc >= m->memSize) {
+        return m->status = STAT_ADR;
+    }
+    fetchLen = m->memSize - pc < YAS_MAX_LENGTH ? m->memSize - pc : YAS_MAX_LENGTH;
+    for (unsigned i = 0; i < fetchLen; i++) {
+        fetched[i] = readByte(m, pc + i);
+    }
+    switch (yasDecode(fetched, fetchLen, pc, &instr)) {
+        case YAS_TRUNCATED:
+            return m->status = STAT_ADR;
+        case YAS_INVALID:
+            return m->status = STAT_INS;
+    }
+    iCd = instr.iCd;
+    iFn = instr.iFn;
+    rA = instr.rA;
+    rB = instr.rB;
+    valC = instr.valC;
+    valP = pc + instr.length;
+
+    valA = m->reg[rA];
+    valB = m->reg[rB];
+
+    switch (iCd) {
+        case I_HALT:
+            m->status = STAT_HLT;
+            break;
+
+        case I_NOP:
+            break;
+
+        case I_RRMOVQ:
+            if (condHolds(m, iFn)) {
+                m->reg[rB] = valA;
+            }
+            break;
+
+        case I_IRMOVQ:
+            m->reg[rB] = valC;
+            break;
+
+        case I_RMMOVQ:
+            if (storeQuad(m, valB + valC, valA) != SUCCESS) {
+                return m->status = STAT_ADR;
+            }
+            break;
+
+        case I_MRMOVQ:
+            if (loadQuad(m, valB + valC, &valM) != SUCCESS) {
+                return m->status = STAT_ADR;
+            }
+            m->reg[rA] = valM;
+            break;
+
+        case I_OPQ:
+            m->of = 0;
+            switch (iFn) {
+                case A_ADDQ:
+                    valE = valB + valA;
+                    m->of = ((int64_t) valA < 0) == ((int64_t) valB < 0)
+                        && ((int64_t) valE < 0) != ((int64_t) valA < 0);
+                    break;
+                case A_SUBQ:
+                    valE = valB - valA;
+                    m->of = ((int64_t) valA < 0) != ((int64_t) valB < 0)
+                        && ((int64_t) valE < 0) != ((int64_t) valB < 0);
+                    break;
+                case A_ANDQ:
+                    valE = valB & valA;
+                    break;
+                case A_XORQ:
+                    valE = valB ^ valA;
+                    break;
+                case A_MULQ:
+                    valE = valB * valA;
+                    break;
+                case A_DIVQ:
+                case A_MODQ:
+                    if (valA == 0) {
+                        return m->status = STAT_INS;
+                    }
+                    valE = iFn == A_DIVQ ? valB / valA : valB % valA;
+                    break;
+                default:
+                    return m->status = STAT_INS;
+            }
+            m->zf = valE == 0;
+            m->sf = (int64_t) valE < 0;
+            m->reg[rB] = valE;
+            break;
+
+        case I_JXX:
+            if (m->predictor != NULL && iFn != C_NC) {
+                predictBranch(m->predictor, pc, valC, condHolds(m, iFn));
+            }
+            if (condHolds(m, iFn)) {
+                valP = valC;
+            }
+            break;
+
+        case I_CALL:
+            valE = m->reg[R_RSP] - 8;
+            if (storeQuad(m, valE, valP) != SUCCESS) {
+                return m->status = STAT_ADR;
+            }
+            m->reg[R_RSP] = valE;
+            if (m->predictor != NULL) {
+                predictCall(m->predictor, valP);
+            }
+            valP = valC;
+            break;
+
+        case I_RET:
+            if (loadQuad(m, m->reg[R_RSP], &valM) != SUCCESS) {
+                return m->status = STAT_ADR;
+            }
+            m->reg[R_RSP] += 8;
+            if (m->predictor != NULL) {
+                predictReturn(m->predictor, pc, valM);
+            }
+            valP = valM;
+            break;
+
+        case I_PUSHQ:
+            valE = m->reg[R_RSP] - 8;
+            if (storeQuad(m, valE, valA) != SUCCESS) {
+                return m->status = STAT_ADR;
+            }
+            m->reg[R_RSP] = valE;
+            break;
+
+        case I_POPQ:
+            if (loadQuad(m, m->reg[R_RSP], &valM) != SUCCESS) {
+                return m->status = STAT_ADR;
+            }
+            m->reg[R_RSP] += 8;
+            m->reg[rA] = valM;
+            break;
+    }
+
+    m->reg[R_NONE] = 0;
+    m->steps++;
+    if (m->status == STAT_AOK) {
+        m->pc = valP;
+    }
+    return m->status;
+}
+
+/* Runs until the machine stops or maxSteps instructions have been
+ * executed (0 means no limit). Returns the number of steps taken.
+ */
+uint64_t runMachine(struct Machine *m, uint64_t maxSteps) {
+    uint64_t start = m->steps;
+
+    while (stepMachine(m) == STAT_AOK) {
+        if (maxSteps != 0 && m->steps - start >= maxSteps) {
+            break;
+        }
+    }
+    return m->steps - start;
+}
+
+const char *statusName(int status) {
+    return status >= STAT_AOK && status <= STAT_INS ? statNames[status] : "???";
+}
+
+void printMachine(FILE *out, struct Machine *m) {
+    fprintf(out, "Stopped in %llu steps at PC = 0x%llx. Status '%s', CC Z=%d S=%d O=%d\n",
+            (unsigned long long) m->steps, (unsigned long long) m->pc,
+            statNames[m->status], m->zf, m->sf, m->of);
+    for (int i = 0; i < R_NONE; i++) {
+        fprintf(out, "%-5s 0x%016llx\n", yasRegisterName(i), (unsigned long long) m->reg[i]);
+    }
+}
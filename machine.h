@@ -0,0 +1,72 @@
+/* This file contains the prototypes and constants needed to use the
+   Y86-64 functional simulator defined in machine.c
+*/
+
+#ifndef _MACHINE_H_
+#define _MACHINE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cache.h"
+#include "predictor.h"
+
+#define STAT_AOK 1
+#define STAT_HLT 2
+#define STAT_ADR 3
+#define STAT_INS 4
+
+#define DEFAULT_MEMSIZE 0x10000
+
+#define PAGE_BITS 12
+#define PAGE_SIZE (1 << PAGE_BITS)
+
+struct Page {
+    unsigned refs;          // Snapshots sharing the page
+    unsigned char data[PAGE_SIZE];
+};
+
+struct Snapshot {
+    uint64_t reg[16];
+    int zf;
+    int sf;
+    int of;
+    uint64_t pc;
+    int status;
+    uint64_t steps;
+    struct Page **pages;    // NULL pages are all zero
+    size_t pageCount;
+    uint64_t memSize;
+};
+
+struct Machine {
+    uint64_t reg[16];
+    int zf;
+    int sf;
+    int of;
+    uint64_t pc;
+    int status;
+    uint64_t steps;
+    struct Page **pages;            // NULL pages are all zero
+    unsigned char *owned;           // Pages this machine may write in place
+    size_t *dirty;                  // Pages copied since base was captured
+    size_t dirtyCount;
+    size_t pageCount;
+    uint64_t memSize;
+    const struct Snapshot *base;    // Snapshot the shared pages come from
+    struct Cache *cache;            // Optional data cache model, may be NULL
+    struct Predictor *predictor;    // Optional branch predictor, may be NULL
+};
+
+int loadMachine(struct Machine *m, FILE *machineCode, uint64_t memSize, uint64_t pc);
+int stepMachine(struct Machine *m);
+uint64_t runMachine(struct Machine *m, uint64_t maxSteps);
+void printMachine(FILE *out, struct Machine *m);
+const char *statusName(int status);
+void freeMachine(struct Machine *m);
+int writeMachineQuad(struct Machine *m, uint64_t addr, uint64_t val);
+
+int takeSnapshot(struct Snapshot *s, struct Machine *m);
+int restoreSnapshot(struct Machine *m, const struct Snapshot *s);
+void freeSnapshot(struct Snapshot *s);
+
+#endif /* MACHINE */
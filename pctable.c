@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "pctable.h"
+
+void pcTableInit(struct PCTable *t, size_t entrySize) {
+    memset(t, 0, sizeof(*t));
+    t->entrySize = entrySize;
+}
+
+static size_t slotFor(const struct PCTable *t, uint64_t pc) {
+    size_t mask = t->capacity - 1;
+    size_t i = (size_t) (pc * 0x9E3779B97F4A7C15ull >> 32) & mask;
+
+    while (t->used[i] && *(uint64_t *) (t->entries + i * t->entrySize) != pc) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow(struct PCTable *t) {
+    size_t capacity = t->capacity ? t->capacity * 2 : 64;
+    unsigned char *entries = calloc(capacity, t->entrySize);
+    unsigned char *used = calloc(capacity, 1);
+    struct PCTable old = *t;
+
+    if (entries == NULL || used == NULL) {
+        free(entries);
+        free(used);
+        return -1;
+    }
+    t->entries = entries;
+    t->used = used;
+    t->capacity = capacity;
+    for (size_t j = 0; j < old.capacity; j++) {
+        if (old.used[j]) {
+            size_t i = slotFor(t, *(uint64_t *) (old.entries + j * t->entrySize));
+
+            memcpy(t->entries + i * t->entrySize, old.entries + j * t->entrySize, t->entrySize);
+            t->used[i] = 1;
+        }
+    }
+    free(old.entries);
+    free(old.used);
+    return 0;
+}
+
+/* Returns the entry for pc, adding a zeroed one if it is new, or NULL
+ * if memory ran out.
+ */
+void *pcTableFind(struct PCTable *t, uint64_t pc) {
+    size_t i;
+
+    if ((t->count + 1) * 2 > t->capacity && grow(t) != 0) {
+        return NULL;
+    }
+    i = slotFor(t, pc);
+    if (!t->used[i]) {
+        t->used[i] = 1;
+        *(uint64_t *) (t->entries + i * t->entrySize) = pc;
+        t->count++;
+    }
+    return t->entries + i * t->entrySize;
+}
+
+static int comparePC(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Returns a malloc'd copy of the entries in pc order and stores their
+ * number in n, or returns NULL if memory ran out.
+ */
+void *pcTableSorted(const struct PCTable *t, size_t *n) {
+    unsigned char *sorted = malloc((t->count + 1) * t->entrySize);
+
+    *n = 0;
+    if (sorted == NULL) {
+        return NULL;
+    }
+    for (size_t i = 0; i < t->capacity; i++) {
+        if (t->used[i]) {
+            memcpy(sorted + *n * t->entrySize, t->entries + i * t->entrySize, t->entrySize);
+            (*n)++;
+        }
+    }
+    qsort(sorted, *n, t->entrySize, comparePC);
+    return sorted;
+}
+
+void pcTableFree(struct PCTable *t) {
+    free(t->entries);
+    free(t->used);
+    pcTableInit(t, t->entrySize);
+}
+
+double percent(uint64_t part, uint64_t whole) {
+    return whole == 0 ? 0.0 : 100.0 * part / whole;
+}
@@ -0,0 +1,26 @@
+/* This file contains the prototypes needed to use the per-PC statistics
+   table defined in pctable.c, shared by the cache and predictor models.
+*/
+
+#ifndef _PCTABLE_H_
+#define _PCTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Entries are caller defined structs whose first member is the uint64_t pc
+struct PCTable {
+    unsigned char *entries;     // Open addressed on pc
+    unsigned char *used;
+    size_t entrySize;
+    size_t capacity;
+    size_t count;
+};
+
+void pcTableInit(struct PCTable *t, size_t entrySize);
+void *pcTableFind(struct PCTable *t, uint64_t pc);
+void *pcTableSorted(const struct PCTable *t, size_t *n);
+void pcTableFree(struct PCTable *t);
+double percent(uint64_t part, uint64_t whole);
+
+#endif /* PCTABLE */
@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "predictor.h"
+
+#define ERROR_RETURN -1
+#define SUCCESS 0
+
+#define DEFAULT_TABLE_BITS 10
+#define DEFAULT_HISTORY_BITS 8
+
+static const char *kindNames[4] = { "taken", "btfnt", "bimodal", "gshare" };
+
+/* Parses a predictor description of the form kind[,tableBits[,historyBits]]
+ * where kind is taken, btfnt, bimodal or gshare.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if the description is malformed.
+ */
+int parsePredictorConfig(const char *spec, struct PredictorConfig *config) {
+    size_t len = strcspn(spec, ",");
+    char *end;
+    int kind = -1;
+
+    for (int i = 0; i < 4; i++) {
+        if (strlen(kindNames[i]) == len && strncmp(spec, kindNames[i], len) == 0) {
+            kind = i;
+        }
+    }
+    if (kind < 0) {
+        return ERROR_RETURN;
+    }
+
+    config->kind = kind;
+    config->tableBits = DEFAULT_TABLE_BITS;
+    config->historyBits = DEFAULT_HISTORY_BITS;
+    spec += len;
+    if (*spec == ',') {
+        config->tableBits = strtoul(spec + 1, &end, 0);
+        if (end == spec + 1) {
+            return ERROR_RETURN;
+        }
+        spec = end;
+    }
+    if (*spec == ',') {
+        config->historyBits = strtoul(spec + 1, &end, 0);
+        if (end == spec + 1) {
+            return ERROR_RETURN;
+        }
+        spec = end;
+    }
+    return *spec == '\0' ? SUCCESS : ERROR_RETURN;
+}
+
+static int predictTaken(struct Predictor *p, uint64_t pc, uint64_t target) {
+    return 1;
+}
+
+static int predictBTFNT(struct Predictor *p, uint64_t pc, uint64_t target) {
+    return target <= pc;
+}
+
+static unsigned bimodalIndex(struct Predictor *p, uint64_t pc) {
+    return pc & ((1u << p->config.tableBits) - 1);
+}
+
+static unsigned gshareIndex(struct Predictor *p, uint64_t pc) {
+    uint64_t history = p->history & ((1ull << p->config.historyBits) - 1);
+
+    return (pc ^ history) & ((1u << p->config.tableBits) - 1);
+}
+
+static int predictBimodal(struct Predictor *p, uint64_t pc, uint64_t target) {
+    return p->counters[bimodalIndex(p, pc)] >= 2;
+}
+
+static int predictGshare(struct Predictor *p, uint64_t pc, uint64_t target) {
+    return p->counters[gshareIndex(p, pc)] >= 2;
+}
+
+static void updateNothing(struct Predictor *p, uint64_t pc, int taken) {
+}
+
+// Moves a 2-bit saturating counter towards the outcome
+static void train(unsigned char *counter, int taken) {
+    if (taken && *counter < 3) {
+        (*counter)++;
+    } else if (!taken && *counter > 0) {
+        (*counter)--;
+    }
+}
+
+static void updateBimodal(struct Predictor *p, uint64_t pc, int taken) {
+    train(&p->counters[bimodalIndex(p, pc)], taken);
+}
+
+static void updateGshare(struct Predictor *p, uint64_t pc, int taken) {
+    train(&p->counters[gshareIndex(p, pc)], taken);
+    p->history = (p->history << 1) | (taken != 0);
+}
+
+/* Sets up the predictor selected by config.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if the configuration is invalid.
+ */
+int predictorInit(struct Predictor *p, const struct PredictorConfig *config) {
+    memset(p, 0, sizeof(*p));
+    pcTableInit(&p->pcStats, sizeof(struct PredictorPCStats));
+    if (config->kind < PRED_TAKEN || config->kind > PRED_GSHARE
+        || config->tableBits > 24 || config->historyBits > 63) {
+        return ERROR_RETURN;
+    }
+    p->config = *config;
+
+    switch (config->kind) {
+        case PRED_TAKEN:
+            p->predict = predictTaken;
+            p->update = updateNothing;
+            break;
+        case PRED_BTFNT:
+            p->predict = predictBTFNT;
+            p->update = updateNothing;
+            break;
+        case PRED_BIMODAL:
+            p->predict = predictBimodal;
+            p->update = updateBimodal;
+            break;
+        case PRED_GSHARE:
+            p->predict = predictGshare;
+            p->update = updateGshare;
+            break;
+    }
+
+    if (config->kind == PRED_BIMODAL || config->kind == PRED_GSHARE) {
+        // Counters start out weakly taken
+        p->counters = malloc((size_t) 1 << config->tableBits);
+        if (p->counters == NULL) {
+            return ERROR_RETURN;
+        }
+        memset(p->counters, 2, (size_t) 1 << config->tableBits);
+    }
+    if (config->rasDepth != 0) {
+        p->ras = calloc(config->rasDepth, sizeof(uint64_t));
+        if (p->ras == NULL) {
+            predictorFree(p);
+            return ERROR_RETURN;
+        }
+    }
+    return SUCCESS;
+}
+
+static void record(struct Predictor *p, uint64_t pc, int taken, int correct, int isReturn) {
+    struct PredictorPCStats *stats = pcTableFind(&p->pcStats, pc);
+
+    if (stats != NULL) {
+        stats->executed++;
+        stats->taken += taken != 0;
+        stats->mispredicts += !correct;
+        stats->isReturn = isReturn;
+    }
+}
+
+/* Predicts the conditional jump at pc, then trains the predictor with
+ * the actual outcome.
+ */
+void predictBranch(struct Predictor *p, uint64_t pc, uint64_t target, int taken) {
+    int guess = p->predict(p, pc, target);
+
+    p->update(p, pc, taken);
+    record(p, pc, taken, (guess != 0) == (taken != 0), 0);
+}
+
+void predictCall(struct Predictor *p, uint64_t returnAddr) {
+    if (p->ras == NULL) {
+        return;
+    }
+    // A full stack overwrites its oldest entry
+    p->ras[p->rasTop] = returnAddr;
+    p->rasTop = (p->rasTop + 1) % p->config.rasDepth;
+    if (p->rasCount < p->config.rasDepth) {
+        p->rasCount++;
+    }
+}
+
+/* Predicts the target of the ret at pc from the return address stack.
+ * Without a stack every ret stalls, which is counted as a mispredict.
+ */
+void predictReturn(struct Predictor *p, uint64_t pc, uint64_t returnAddr) {
+    int correct = 0;
+
+    if (p->ras != NULL && p->rasCount != 0) {
+        p->rasTop = (p->rasTop + p->config.rasDepth - 1) % p->config.rasDepth;
+        p->rasCount--;
+        correct = p->ras[p->rasTop] == returnAddr;
+    }
+    record(p, pc, 1, correct, 1);
+}
+
+/* Prints the overall mispredict rate and cycle penalty followed by one
+ * line for every jXX and ret PC, in address order.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if there were write problems.
+ */
+int predictorPrintStats(FILE *out, struct Predictor *p) {
+    struct PredictorPCStats *sorted;
+    uint64_t executed = 0;
+    uint64_t mispredicts = 0;
+    uint64_t penalty = 0;
+    size_t n;
+    int res;
+
+    sorted = pcTableSorted(&p->pcStats, &n);
+    if (sorted == NULL) {
+        return ERROR_RETURN;
+    }
+    for (size_t i = 0; i < n; i++) {
+        executed += sorted[i].executed;
+        mispredicts += sorted[i].mispredicts;
+        penalty += sorted[i].mispredicts
+            * (sorted[i].isReturn ? RET_PENALTY : BRANCH_PENALTY);
+    }
+
+    res = fprintf(out, "Predictor %s, RAS depth %u: %llu mispredicts in %llu (%.2f%%), %llu penalty cycles\n",
+                  kindNames[p->config.kind], p->config.rasDepth,
+                  (unsigned long long) mispredicts, (unsigned long long) executed,
+                  percent(mispredicts, executed), (unsigned long long) penalty);
+    if (res > 0) {
+        res = fprintf(out, "%-18s %-4s %10s %10s %11s %8s %8s\n",
+                      "PC", "kind", "executed", "taken", "mispredicts", "miss%", "penalty");
+    }
+    for (size_t i = 0; i < n && res > 0; i++) {
+        res = fprintf(out, "%016llx:  %-4s %10llu %10llu %11llu %7.2f%% %8llu\n",
+                      (unsigned long long) sorted[i].pc,
+                      sorted[i].isReturn ? "ret" : "jXX",
+                      (unsigned long long) sorted[i].executed,
+                      (unsigned long long) sorted[i].taken,
+                      (unsigned long long) sorted[i].mispredicts,
+                      percent(sorted[i].mispredicts, sorted[i].executed),
+                      (unsigned long long) (sorted[i].mispredicts
+                          * (sorted[i].isReturn ? RET_PENALTY : BRANCH_PENALTY)));
+    }
+    free(sorted);
+    return res > 0 ? SUCCESS : ERROR_RETURN;
+}
+
+void predictorFree(struct Predictor *p) {
+    free(p->counters);
+    free(p->ras);
+    pcTableFree(&p->pcStats);
+    p->counters = NULL;
+    p->ras = NULL;
+}
@@ -0,0 +1,56 @@
+/* This file contains the prototypes and constants needed to use the
+   branch predictor models defined in predictor.c
+*/
+
+#ifndef _PREDICTOR_H_
+#define _PREDICTOR_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pctable.h"
+
+#define PRED_TAKEN 0
+#define PRED_BTFNT 1
+#define PRED_BIMODAL 2
+#define PRED_GSHARE 3
+
+// Cycles lost by the PIPE implementation when it guesses wrong
+#define BRANCH_PENALTY 2
+#define RET_PENALTY 3
+
+struct PredictorConfig {
+    int kind;               // One of the PRED_ constants
+    unsigned tableBits;     // log2 of the counter table size
+    unsigned historyBits;   // Global history length for gshare
+    unsigned rasDepth;      // Return address stack entries, 0 for none
+};
+
+struct PredictorPCStats {
+    uint64_t pc;
+    uint64_t executed;
+    uint64_t taken;
+    uint64_t mispredicts;
+    int isReturn;
+};
+
+struct Predictor {
+    struct PredictorConfig config;
+    int (*predict)(struct Predictor *p, uint64_t pc, uint64_t target);
+    void (*update)(struct Predictor *p, uint64_t pc, int taken);
+    unsigned char *counters;
+    uint64_t history;
+    uint64_t *ras;
+    unsigned rasTop;
+    unsigned rasCount;
+    struct PCTable pcStats;         // Of struct PredictorPCStats
+};
+
+int parsePredictorConfig(const char *spec, struct PredictorConfig *config);
+int predictorInit(struct Predictor *p, const struct PredictorConfig *config);
+void predictBranch(struct Predictor *p, uint64_t pc, uint64_t target, int taken);
+void predictCall(struct Predictor *p, uint64_t returnAddr);
+void predictReturn(struct Predictor *p, uint64_t pc, uint64_t returnAddr);
+int predictorPrintStats(FILE *out, struct Predictor *p);
+void predictorFree(struct Predictor *p);
+
+#endif /* PREDICTOR */
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "machine.h"
+#include "runner.h"
+
+#define ERROR_RETURN -1
+#define SUCCESS 0
+
+struct Worker {
+    pthread_t thread;
+    const struct Snapshot *snapshot;
+    unsigned first;         // Runs first, first + stride, ...
+    unsigned stride;
+    unsigned runs;
+    uint64_t maxSteps;
+    RunHook setup;
+    RunHook finish;
+    void *context;
+    int result;
+};
+
+static void *work(void *arg) {
+    struct Worker *w = arg;
+    struct Machine m;
+
+    // Each worker keeps one machine and resets it between runs, so a
+    // run only pays for the pages the previous one wrote
+    memset(&m, 0, sizeof(m));
+    w->result = SUCCESS;
+    for (unsigned run = w->first; run < w->runs; run += w->stride) {
+        if (restoreSnapshot(&m, w->snapshot) != SUCCESS) {
+            w->result = ERROR_RETURN;
+            break;
+        }
+        if (w->setup != NULL) {
+            w->setup(&m, run, w->context);
+        }
+        runMachine(&m, w->maxSteps);
+        if (w->finish != NULL) {
+            w->finish(&m, run, w->context);
+        }
+    }
+    freeMachine(&m);
+    return NULL;
+}
+
+/* Runs the program captured in s runs times, spread over threads
+ * threads. setup is called on each restored machine before it runs
+ * (e.g. to write that run's input) and finish once it stops; either
+ * may be NULL. Hooks for different runs may be called concurrently.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if a thread or machine could not
+ * be created.
+ */
+int runFromSnapshot(const struct Snapshot *s, unsigned runs, unsigned threads, uint64_t maxSteps,
+                    RunHook setup, RunHook finish, void *context) {
+    struct Worker *workers;
+    unsigned started = 0;
+    int res = SUCCESS;
+
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > runs) {
+        threads = runs;
+    }
+    workers = calloc(threads, sizeof(struct Worker));
+    if (workers == NULL) {
+        return ERROR_RETURN;
+    }
+
+    for (unsigned t = 0; t < threads; t++) {
+        workers[t].snapshot = s;
+        workers[t].first = t;
+        workers[t].stride = threads;
+        workers[t].runs = runs;
+        workers[t].maxSteps = maxSteps;
+        workers[t].setup = setup;
+        workers[t].finish = finish;
+        workers[t].context = context;
+        if (pthread_create(&workers[t].thread, NULL, work, &workers[t]) != 0) {
+            res = ERROR_RETURN;
+            break;
+        }
+        started++;
+    }
+    for (unsigned t = 0; t < started; t++) {
+        pthread_join(workers[t].thread, NULL);
+        if (workers[t].result != SUCCESS) {
+            res = ERROR_RETURN;
+        }
+    }
+    free(workers);
+    return res;
+}
@@ -0,0 +1,17 @@
+/* This file contains the prototypes needed to use the snapshot runner
+   defined in runner.c
+*/
+
+#ifndef _RUNNER_H_
+#define _RUNNER_H_
+
+#include <stdint.h>
+#include "machine.h"
+
+// Called before and after each run on the thread that does the run
+typedef void (*RunHook)(struct Machine *m, unsigned run, void *context);
+
+int runFromSnapshot(const struct Snapshot *s, unsigned runs, unsigned threads, uint64_t maxSteps,
+                    RunHook setup, RunHook finish, void *context);
+
+#endif /* RUNNER */
@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "machine.h"
+#include "cache.h"
+#include "predictor.h"
+#include "runner.h"
+
+#define ERROR_RETURN -1
+#define SUCCESS 0
+
+struct RunResult {
+    int status;
+    uint64_t steps;
+    uint64_t rax;
+};
+
+struct Runs {
+    uint64_t patchAddr;
+    int patch;
+    struct RunResult *results;
+};
+
+// Gives every run a different input by storing its number at patchAddr
+static void setupRun(struct Machine *m, unsigned run, void *context) {
+    struct Runs *runs = context;
+
+    if (runs->patch) {
+        writeMachineQuad(m, runs->patchAddr, run);
+    }
+}
+
+static void finishRun(struct Machine *m, unsigned run, void *context) {
+    struct Runs *runs = context;
+
+    runs->results[run].status = m->status;
+    runs->results[run].steps = m->steps;
+    runs->results[run].rax = m->reg[0];
+}
+
+/* Runs prefix steps of the loaded program, snapshots it and forks
+ * count runs off the snapshot over threads threads.
+ *
+ * Returns SUCCESS, or ERROR_RETURN if the runs could not be started.
+ */
+static int runMany(struct Machine *m, uint64_t prefix, unsigned count, unsigned threads,
+                   uint64_t maxSteps, struct Runs *runs) {
+    struct Snapshot snapshot;
+    int res;
+
+    // Report the number of threads the runner will really use
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+    if (prefix != 0) {
+        runMachine(m, prefix);
+    }
+    runs->results = calloc(count, sizeof(struct RunResult));
+    if (runs->results == NULL || takeSnapshot(&snapshot, m) != SUCCESS) {
+        free(runs->results);
+        return ERROR_RETURN;
+    }
+
+    res = runFromSnapshot(&snapshot, count, threads, maxSteps, setupRun, finishRun, runs);
+    if (res == SUCCESS) {
+        printf("Forked %u runs over %u threads after %llu steps\n", count, threads,
+               (unsigned long long) m->steps);
+        for (unsigned i = 0; i < count; i++) {
+            printf("run %u: status '%s', %llu steps, %%rax 0x%016llx\n", i, statusName(runs->results[i].status),
+                   (unsigned long long) runs->results[i].steps,
+                   (unsigned long long) runs->results[i].rax);
+        }
+    }
+
+    // The snapshot shares pages with m, so m has to go first
+    freeMachine(m);
+    freeSnapshot(&snapshot);
+    free(runs->results);
+    return res;
+}
+
+static void usage(char *prog) {
+    printf("Usage: %s [-m memSize] [-n maxSteps] [-1 l1Cache] [-2 l2Cache] [-b predictor] [-r rasDepth]"
+           " [-R runs [-j threads] [-s prefixSteps] [-p patchAddr]] InputFilename [startingOffset]\n", prog);
+    printf("  A cache is described as size,ways,lineSize[,lru|plru], e.g. -1 32k,8,64,plru\n");
+    printf("  A predictor is taken, btfnt, bimodal[,tableBits] or gshare[,tableBits[,historyBits]]\n");
+    printf("  -R snapshots the program after prefixSteps and forks runs off it, storing\n"
+           "  each run's number at patchAddr first; caches and predictors are not modelled\n");
+}
+
+int main(int argc, char **argv) {
+
+    FILE *machineCode;
+    struct Machine machine;
+    struct Cache cache;
+    struct CacheConfig l1 = { 0, 0, 0, CACHE_LRU };
+    struct CacheConfig l2 = { 0, 0, 0, CACHE_LRU };
+    struct Predictor predictor;
+    struct PredictorConfig predictorConfig = { PRED_TAKEN, 0, 0, 0 };
+    int predict = 0;
+    struct Runs runs = { 0, 0, NULL };
+    unsigned runCount = 0;
+    unsigned threads = 1;
+    uint64_t prefix = 0;
+    uint64_t memSize = DEFAULT_MEMSIZE;
+    uint64_t maxSteps = 0;
+    uint64_t PC = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:1:2:b:r:R:j:s:p:")) != -1) {
+        switch (opt) {
+            case 'm':
+                memSize = strtoull(optarg, NULL, 0);
+                break;
+            case 'n':
+                maxSteps = strtoull(optarg, NULL, 0);
+                break;
+            case '1':
+                if (parseCacheConfig(optarg, &l1) != SUCCESS) {
+                    printf("Invalid L1 cache description: %s\n", optarg);
+                    return ERROR_RETURN;
+                }
+                break;
+            case '2':
+                if (parseCacheConfig(optarg, &l2) != SUCCESS) {
+                    printf("Invalid L2 cache description: %s\n", optarg);
+                    return ERROR_RETURN;
+                }
+                break;
+            case 'b':
+                if (parsePredictorConfig(optarg, &predictorConfig) != SUCCESS) {
+                    printf("Invalid predictor description: %s\n", optarg);
+                    return ERROR_RETURN;
+                }
+                predict = 1;
+                break;
+            case 'r':
+                predictorConfig.rasDepth = strtoul(optarg, NULL, 0);
+                predict = 1;
+                break;
+            case 'R':
+                runCount = strtoul(optarg, NULL, 0);
+                break;
+            case 'j':
+                threads = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                prefix = strtoull(optarg, NULL, 0);
+                break;
+            case 'p':
+                runs.patchAddr = strtoull(optarg, NULL, 0);
+                runs.patch = 1;
+                break;
+            default:
+                usage(argv[0]);
+                return ERROR_RETURN;
+        }
+    }
+
+    // Verify that the command line has an appropriate number
+    // of arguments
+    if (argc - optind < 1 || argc - optind > 2) {
+        usage(argv[0]);
+        return ERROR_RETURN;
+    }
+    if (l2.size != 0 && l1.size == 0) {
+        printf("An L2 cache needs an L1 cache\n");
+        return ERROR_RETURN;
+    }
+
+    machineCode = fopen(argv[optind], "rb");
+
+    if (machineCode == NULL) {
+        printf("Failed to open %s: %s\n", argv[optind], strerror(errno));
+        return ERROR_RETURN;
+    }
+
+    // If there is a 2nd argument present it is the initial value
+    // of the program counter.
+    if (argc - optind == 2) {
+        errno = 0;
+        PC = strtoull(argv[optind + 1], NULL, 0);
+        if (errno != 0) {
+            perror("Invalid offset on command line");
+            fclose(machineCode);
+            return ERROR_RETURN;
+        }
+    }
+
+    if (loadMachine(&machine, machineCode, memSize, PC) != SUCCESS) {
+        printf("Failed to load %s\n", argv[optind]);
+        fclose(machineCode);
+        return ERROR_RETURN;
+    }
+    fclose(machineCode);
+
+    if (runCount != 0) {
+        if (l1.size != 0 || predict) {
+            printf("Caches and predictors cannot be combined with -R\n");
+            freeMachine(&machine);
+            return ERROR_RETURN;
+        }
+        if (runs.patch && (runs.patchAddr > machine.memSize || machine.memSize - runs.patchAddr < 8)) {
+            printf("Patch address 0x%" PRIX64 " is outside memory\n", runs.patchAddr);
+            freeMachine(&machine);
+            return ERROR_RETURN;
+        }
+        printf("Opened %s, starting PC 0x%016" PRIX64 "\n", argv[optind], PC);
+        if (runMany(&machine, prefix, runCount, threads, maxSteps, &runs) != SUCCESS) {
+            printf("Failed to start the runs\n");
+            return ERROR_RETURN;
+        }
+        return SUCCESS;
+    }
+
+    if (l1.size != 0) {
+        if (cacheInit(&cache, &l1, &l2) != SUCCESS) {
+            printf("Cache sizes, ways and line sizes must be powers of two that fit together,"
+                   " with L2 lines no smaller than L1 lines\n");
+            freeMachine(&machine);
+            return ERROR_RETURN;
+        }
+        machine.cache = &cache;
+    }
+
+    if (predict) {
+        if (predictorInit(&predictor, &predictorConfig) != SUCCESS) {
+            printf("Invalid predictor configuration\n");
+            if (machine.cache != NULL) {
+                cacheFree(&cache);
+            }
+            freeMachine(&machine);
+            return ERROR_RETURN;
+        }
+        machine.predictor = &predictor;
+    }
+
+    printf("Opened %s, starting PC 0x%016" PRIX64 "\n", argv[optind], PC);
+
+    runMachine(&machine, maxSteps);
+    printMachine(stdout, &machine);
+
+    if (machine.cache != NULL) {
+        cachePrintStats(stdout, &cache);
+        cacheFree(&cache);
+    }
+    if (machine.predictor != NULL) {
+        predictorPrintStats(stdout, &predictor);
+        predictorFree(&predictor);
+    }
+
+    freeMachine(&machine);
+    return SUCCESS;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "instructions.h"
+#include "yas.h"
+
+static const char *regNames[16] = {
+    "%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+    "%r8", "%r9", "%r10", "%r11", "%r12", "%r13", "%r14", NULL
+};
+
+static const char *opNames[7] = { "addq", "subq", "andq", "xorq", "mulq", "divq", "modq" };
+static const char *jumpNames[7] = { "jmp", "jle", "jl", "je", "jne", "jge", "jg" };
+static const char *moveNames[7] = { "rrmovq", "cmovle", "cmovl", "cmove", "cmovne", "cmovge", "cmovg" };
+
+const char *yasRegisterName(int r) {
+    return r >= 0 && r < 16 ? regNames[r] : NULL;
+}
+
+static int invalid(const unsigned char *buf, uint64_t addr, struct YasInstr *instr) {
+    memset(instr, 0, sizeof(*instr));
+    instr->addr = addr;
+    instr->bytes[0] = buf[0];
+    instr->length = 1;
+    instr->rA = R_NONE;
+    instr->rB = R_NONE;
+    return YAS_INVALID;
+}
+
+/* Decodes the instruction at the start of buf, which holds len bytes
+ * and sits at address addr.
+ *
+ * Returns YAS_OK, YAS_TRUNCATED if len is too short to tell, or
+ * YAS_INVALID in which case instr describes the first byte on its own.
+ */
+int yasDecode(const unsigned char *buf, size_t len, uint64_t addr, struct YasInstr *instr) {
+    int length = 1;
+    int hasRegs = 0;
+    int hasValC = 0;
+    int iCd, iFn, rA, rB;
+    int ok;
+
+    if (len == 0) {
+        return YAS_TRUNCATED;
+    }
+    iCd = buf[0] >> 4;
+    iFn = buf[0] & 0xf;
+
+    switch (iCd) {
+        case I_HALT:
+        case I_NOP:
+        case I_RET:
+            break;
+        case I_RRMOVQ:
+        case I_OPQ:
+        case I_PUSHQ:
+        case I_POPQ:
+            hasRegs = 1;
+            break;
+        case I_IRMOVQ:
+        case I_RMMOVQ:
+        case I_MRMOVQ:
+            hasRegs = 1;
+            hasValC = 1;
+            break;
+        case I_JXX:
+        case I_CALL:
+            hasValC = 1;
+            break;
+        default:
+            return invalid(buf, addr, instr);
+    }
+    length += hasRegs + 8 * hasValC;
+    if (len < (size_t) length) {
+        return YAS_TRUNCATED;
+    }
+
+    rA = hasRegs ? buf[1] >> 4 : R_NONE;
+    rB = hasRegs ? buf[1] & 0xf : R_NONE;
+
+    switch (iCd) {
+        case I_RRMOVQ:
+            ok = iFn <= C_G && rA != R_NONE && rB != R_NONE;
+            break;
+        case I_OPQ:
+            ok = iFn <= A_MODQ && rA != R_NONE && rB != R_NONE;
+            break;
+        case I_JXX:
+            ok = iFn <= C_G;
+            break;
+        case I_IRMOVQ:
+            ok = iFn == 0 && rA == R_NONE && rB != R_NONE;
+            break;
+        case I_RMMOVQ:
+        case I_MRMOVQ:
+            ok = iFn == 0 && rA != R_NONE;
+            break;
+        case I_PUSHQ:
+        case I_POPQ:
+            ok = iFn == 0 && rA != R_NONE && rB == R_NONE;
+            break;
+        default:
+            ok = iFn == 0;
+    }
+    if (!ok) {
+        return invalid(buf, addr, instr);
+    }
+
+    instr->addr = addr;
+    memcpy(instr->bytes, buf, length);
+    instr->length = length;
+    instr->valid = 1;
+    instr->iCd = iCd;
+    instr->iFn = iFn;
+    instr->rA = rA;
+    instr->rB = rB;
+    instr->valC = 0;
+    for (int i = 0; i < 8 * hasValC; i++) {
+        instr->valC |= (uint64_t) buf[1 + hasRegs + i] << (i * 8);
+    }
+    return YAS_OK;
+}
+
+/* Decodes consecutive instructions from buf into instrs, stopping after
+ * max instructions or when the buffer ends part way through one. Invalid
+ * bytes are decoded one at a time with valid set to 0.
+ *
+ * Returns the number of instructions decoded and, if used is not NULL,
+ * stores the number of bytes they cover there.
+ */
+size_t yasDecodeBuffer(const unsigned char *buf, size_t len, uint64_t addr,
+                       struct YasInstr *instrs, size_t max, size_t *used) {
+    size_t offset = 0;
+    size_t n = 0;
+
+    while (n < max && yasDecode(buf + offset, len - offset, addr + offset, &instrs[n]) != YAS_TRUNCATED) {
+        offset += instrs[n].length;
+        n++;
+    }
+    if (used != NULL) {
+        *used = offset;
+    }
+    return n;
+}
+
+/* Formats instr as a listing line (without a newline) following the
+ * rules in printRoutines.c.
+ *
+ * Returns the length of the line, or YAS_ERROR if it did not fit.
+ */
+int yasFormat(const struct YasInstr *instr, char *out, size_t size) {
+    char hex[2 * YAS_MAX_LENGTH + 1];
+    char operands[64];
+    const char *name;
+    unsigned long long valC = instr->valC;
+    int res;
+
+    for (int i = 0; i < instr->length; i++) {
+        sprintf(hex + 2 * i, "%02X", instr->bytes[i]);
+    }
+    hex[2 * instr->length] = '\0';
+    operands[0] = '\0';
+
+    if (!instr->valid) {
+        name = ".byte";
+        sprintf(operands, "0x%x", instr->bytes[0]);
+    } else {
+        switch (instr->iCd) {
+            case I_HALT:
+                name = "halt";
+                break;
+            case I_NOP:
+                name = "nop";
+                break;
+            case I_RET:
+                name = "ret";
+                break;
+            case I_RRMOVQ:
+                name = moveNames[instr->iFn];
+                sprintf(operands, "%s, %s", regNames[instr->rA], regNames[instr->rB]);
+                break;
+            case I_OPQ:
+                name = opNames[instr->iFn];
+                sprintf(operands, "%s, %s", regNames[instr->rA], regNames[instr->rB]);
+                break;
+            case I_IRMOVQ:
+                name = "irmovq";
+                sprintf(operands, "$0x%llx, %s", valC, regNames[instr->rB]);
+                break;
+            case I_RMMOVQ:
+                name = "rmmovq";
+                if (instr->rB == R_NONE) {
+                    sprintf(operands, "%s, 0x%llx", regNames[instr->rA], valC);
+                } else {
+                    sprintf(operands, "%s, 0x%llx(%s)", regNames[instr->rA], valC, regNames[instr->rB]);
+                }
+                break;
+            case I_MRMOVQ:
+                name = "mrmovq";
+                if (instr->rB == R_NONE) {
+                    sprintf(operands, "0x%llx, %s", valC, regNames[instr->rA]);
+                } else {
+                    sprintf(operands, "0x%llx(%s), %s", valC, regNames[instr->rB], regNames[instr->rA]);
+                }
+                break;
+            case I_JXX:
+                name = jumpNames[instr->iFn];
+                sprintf(operands, "0x%llx", valC);
+                break;
+            case I_CALL:
+                name = "call";
+                sprintf(operands, "0x%llx", valC);
+                break;
+            case I_PUSHQ:
+                name = "pushq";
+                strcpy(operands, regNames[instr->rA]);
+                break;
+            case I_POPQ:
+                name = "popq";
+                strcpy(operands, regNames[instr->rA]);
+                break;
+            default:
+                return YAS_ERROR;
+        }
+    }
+
+    if (operands[0] == '\0') {
+        res = snprintf(out, size, "%016llx: %-22s%s", (unsigned long long) instr->addr, hex, name);
+    } else {
+        res = snprintf(out, size, "%016llx: %-22s%-8s%s", (unsigned long long) instr->addr, hex, name, operands);
+    }
+    return res < 0 || (size_t) res >= size ? YAS_ERROR : res;
+}
@@ -0,0 +1,58 @@
+/* This file contains the public API of libyas: the Y86-64 decoding
+   and formatting routines defined in yas.c, the assembler defined in
+   yasasm.c and the register dataflow analysis defined in yasflow.c.
+   The library keeps no global state, so it may be used from several
+   threads at once.
+*/
+
+#ifndef _YAS_H_
+#define _YAS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define YAS_OK 0
+#define YAS_INVALID -1      // Bytes do not encode an instruction
+#define YAS_TRUNCATED -2    // Buffer ends part way through an instruction
+#define YAS_ERROR -3        // Output buffer is too small
+
+#define YAS_MAX_LENGTH 10
+#define YAS_CC 0x8000       // Condition codes in a register mask
+#define YAS_LINE_SIZE 128   // Always large enough for yasFormat()
+
+struct YasInstr {
+    uint64_t addr;
+    unsigned char bytes[YAS_MAX_LENGTH];
+    int length;             // 1 for invalid bytes, which are shown as .byte
+    int valid;
+    int iCd;
+    int iFn;
+    int rA;
+    int rB;
+    uint64_t valC;
+};
+
+// Register dataflow facts for one instruction, as masks with bit r
+// for register r
+struct YasFlow {
+    uint16_t use;
+    uint16_t def;
+    uint16_t liveIn;
+    uint16_t liveOut;
+    uint16_t dead;          // Registers written but never read afterwards
+    uint16_t undefined;     // Registers read with no definition reaching
+    int leader;             // Starts a basic block
+    size_t target;          // Index of the jump or call target, or (size_t) -1
+};
+
+int yasDecode(const unsigned char *buf, size_t len, uint64_t addr, struct YasInstr *instr);
+size_t yasDecodeBuffer(const unsigned char *buf, size_t len, uint64_t addr,
+                       struct YasInstr *instrs, size_t max, size_t *used);
+int yasFormat(const struct YasInstr *instr, char *out, size_t size);
+const char *yasRegisterName(int r);
+int yasAssemble(const char *source, size_t len, unsigned char **image, size_t *size,
+                char *error, size_t errorSize);
+int yasAnalyze(const struct YasInstr *instrs, size_t n, struct YasFlow *flow);
+int yasFormatMask(uint16_t mask, char *out, size_t size);
+
+#endif /* YAS */
@@ -0,0 +1,673 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include "instructions.h"
+#include "yas.h"
+
+/* A two pass Y86-64 assembler. The first pass tokenizes the source a
+ * line at a time, parses each statement, assigns addresses and records
+ * labels in a hashed symbol table. The second pass resolves label
+ * references and writes the encoded bytes into the image. Statements
+ * and the label tokens they refer to are carved out of an arena and
+ * freed all at once, and names point back into the source instead of
+ * being copied.
+ */
+
+#define ARENA_BLOCK (64 * 1024)
+#define MAX_TOKENS 32
+
+enum TokenKind { T_IDENT, T_NUMBER, T_REG, T_DIRECTIVE, T_DOLLAR, T_COMMA, T_LPAREN, T_RPAREN, T_COLON };
+
+struct Token {
+    enum TokenKind kind;
+    const char *text;
+    size_t len;
+    uint64_t value;         // Numbers and register numbers
+    unsigned line;
+};
+
+// What a statement emits. Instructions use their icode.
+enum { S_QUAD = 0x10, S_BYTE, S_POS, S_ALIGN };
+
+struct Stmt {
+    struct Stmt *next;
+    unsigned char kind;
+    unsigned char iFn;
+    unsigned char rA;
+    unsigned char rB;
+    uint64_t addr;
+    uint64_t valC;
+    const struct Token *sym;    // Label whose value replaces valC, or NULL
+    unsigned line;
+};
+
+struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    /* Followed by the memory handed out */
+};
+
+struct Symbol {
+    const char *name;       // NULL for an empty slot
+    size_t len;
+    uint64_t value;
+};
+
+struct Assembler {
+    const char *src;
+    const char *end;
+    const char *pos;
+    unsigned line;
+    struct ArenaBlock *arena;
+    struct Symbol *symbols;
+    size_t symbolCapacity;
+    size_t symbolCount;
+    struct Stmt *first;
+    struct Stmt *last;
+    char *error;
+    size_t errorSize;
+};
+
+struct Mnemonic {
+    const char *name;
+    size_t len;
+    int iCd;
+    int iFn;
+};
+
+#define MNEMONIC(name, iCd, iFn) { name, sizeof(name) - 1, iCd, iFn }
+
+static const struct Mnemonic mnemonics[] = {
+    MNEMONIC("halt", I_HALT, 0), MNEMONIC("nop", I_NOP, 0), MNEMONIC("ret", I_RET, 0),
+    MNEMONIC("rrmovq", I_RRMOVQ, C_NC), MNEMONIC("cmovle", I_RRMOVQ, C_LE),
+    MNEMONIC("cmovl", I_RRMOVQ, C_L), MNEMONIC("cmove", I_RRMOVQ, C_E),
+    MNEMONIC("cmovne", I_RRMOVQ, C_NE), MNEMONIC("cmovge", I_RRMOVQ, C_GE),
+    MNEMONIC("cmovg", I_RRMOVQ, C_G), MNEMONIC("irmovq", I_IRMOVQ, 0),
+    MNEMONIC("rmmovq", I_RMMOVQ, 0), MNEMONIC("mrmovq", I_MRMOVQ, 0),
+    MNEMONIC("addq", I_OPQ, A_ADDQ), MNEMONIC("subq", I_OPQ, A_SUBQ),
+    MNEMONIC("andq", I_OPQ, A_ANDQ), MNEMONIC("xorq", I_OPQ, A_XORQ),
+    MNEMONIC("mulq", I_OPQ, A_MULQ), MNEMONIC("divq", I_OPQ, A_DIVQ),
+    MNEMONIC("modq", I_OPQ, A_MODQ), MNEMONIC("jmp", I_JXX, C_NC),
+    MNEMONIC("jle", I_JXX, C_LE), MNEMONIC("jl", I_JXX, C_L), MNEMONIC("je", I_JXX, C_E),
+    MNEMONIC("jne", I_JXX, C_NE), MNEMONIC("jge", I_JXX, C_GE), MNEMONIC("jg", I_JXX, C_G),
+    MNEMONIC("call", I_CALL, 0), MNEMONIC("pushq", I_PUSHQ, 0), MNEMONIC("popq", I_POPQ, 0),
+    { NULL, 0, 0, 0 }
+};
+
+static int fail(struct Assembler *a, unsigned line, const char *format, ...) {
+    va_list args;
+    int n;
+
+    if (a->errorSize == 0) {
+        return YAS_INVALID;
+    }
+    n = snprintf(a->error, a->errorSize, "line %u: ", line);
+    if (n >= 0 && (size_t) n < a->errorSize) {
+        va_start(args, format);
+        vsnprintf(a->error + n, a->errorSize - n, format, args);
+        va_end(args);
+    }
+    return YAS_INVALID;
+}
+
+static void *arenaAlloc(struct Assembler *a, size_t size) {
+    struct ArenaBlock *block = a->arena;
+    void *p;
+
+    size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (block == NULL || block->size - block->used < size) {
+        size_t blockSize = size > ARENA_BLOCK ? size : ARENA_BLOCK;
+
+        block = malloc(sizeof(struct ArenaBlock) + blockSize);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = a->arena;
+        block->used = 0;
+        block->size = blockSize;
+        a->arena = block;
+    }
+    p = (char *) (block + 1) + block->used;
+    block->used += size;
+    return p;
+}
+
+static void arenaFree(struct Assembler *a) {
+    while (a->arena != NULL) {
+        struct ArenaBlock *next = a->arena->next;
+        free(a->arena);
+        a->arena = next;
+    }
+}
+
+// FNV-1a
+static size_t hashName(const char *name, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char) name[i]) * 0x100000001b3ull;
+    }
+    return (size_t) (h ^ (h >> 32));
+}
+
+static struct Symbol *findSymbol(struct Assembler *a, const char *name, size_t len) {
+    size_t mask = a->symbolCapacity - 1;
+    size_t i = hashName(name, len) & mask;
+
+    while (a->symbols[i].name != NULL
+           && (a->symbols[i].len != len || memcmp(a->symbols[i].name, name, len) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return &a->symbols[i];
+}
+
+static int defineSymbol(struct Assembler *a, const struct Token *t, uint64_t value) {
+    struct Symbol *sym;
+
+    if ((a->symbolCount + 1) * 2 > a->symbolCapacity) {
+        struct Symbol *old = a->symbols;
+        size_t oldCapacity = a->symbolCapacity;
+
+        a->symbolCapacity = oldCapacity ? oldCapacity * 2 : 256;
+        a->symbols = calloc(a->symbolCapacity, sizeof(struct Symbol));
+        if (a->symbols == NULL) {
+            a->symbols = old;
+            a->symbolCapacity = oldCapacity;
+            return fail(a, t->line, "out of memory");
+        }
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (old[i].name != NULL) {
+                *findSymbol(a, old[i].name, old[i].len) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    sym = findSymbol(a, t->text, t->len);
+    if (sym->name != NULL) {
+        return fail(a, t->line, "label %.*s defined twice", (int) t->len, t->text);
+    }
+    sym->name = t->text;
+    sym->len = t->len;
+    sym->value = value;
+    a->symbolCount++;
+    return YAS_OK;
+}
+
+static int isIdentStart(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int isIdentChar(int c) {
+    return isIdentStart(c) || (c >= '0' && c <= '9');
+}
+
+static int parseNumber(const char *p, const char *end, const char **after, uint64_t *value) {
+    int negative = 0;
+    int base = 10;
+    uint64_t v = 0;
+    const char *start;
+
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    }
+    start = p;
+    for (; p < end; p++) {
+        int digit;
+
+        if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+        } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+        } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+        } else {
+            break;
+        }
+        v = v * base + digit;
+    }
+    if (p == start || (p < end && isIdentChar(*p))) {
+        return YAS_INVALID;
+    }
+    *after = p;
+    *value = negative ? (uint64_t) 0 - v : v;
+    return YAS_OK;
+}
+
+/* Tokenizes the next line into buf, leaving a->pos at the start of
+ * the following one (or just after a comment that ends the line by
+ * spanning several).
+ *
+ * Returns the number of tokens stored, or YAS_INVALID.
+ */
+static int tokenizeLine(struct Assembler *a, struct Token buf[MAX_TOKENS]) {
+    int n = 0;
+    const char *p = a->pos;
+    unsigned line = a->line;
+
+    while (p < a->end && *p != '\n') {
+        struct Token *t = &buf[n];
+        char c = *p;
+
+        if (c == ' ' || c == '\t' || c == '\r') {
+            p++;
+            continue;
+        }
+        if (c == '#') {
+            while (p < a->end && *p != '\n') {
+                p++;
+            }
+            break;
+        }
+        if (c == '/' && p + 1 < a->end && p[1] == '*') {
+            for (p += 2; p < a->end && !(*p == '*' && p + 1 < a->end && p[1] == '/'); p++) {
+                if (*p == '\n') {
+                    a->line++;
+                }
+            }
+            if (p >= a->end) {
+                return fail(a, line, "unterminated comment");
+            }
+            p += 2;
+            // A comment that crosses a newline ends the statement, and
+            // the rest of its closing line is tokenized on its own
+            if (a->line != line) {
+                a->pos = p;
+                return n;
+            }
+            continue;
+        }
+        if (n == MAX_TOKENS) {
+            return fail(a, line, "too many tokens");
+        }
+
+        t->text = p;
+        t->line = line;
+        t->value = 0;
+        if (isIdentStart(c) || c == '.' || c == '%') {
+            t->kind = c == '.' ? T_DIRECTIVE : c == '%' ? T_REG : T_IDENT;
+            for (p++; p < a->end && isIdentChar(*p); p++)
+                ;
+            t->len = p - t->text;
+            if (t->kind == T_REG) {
+                int r;
+
+                for (r = 0; r < R_NONE; r++) {
+                    const char *name = yasRegisterName(r);
+                    if (strlen(name) == t->len && memcmp(name, t->text, t->len) == 0) {
+                        break;
+                    }
+                }
+                if (r == R_NONE) {
+                    return fail(a, line, "unknown register %.*s", (int) t->len, t->text);
+                }
+                t->value = r;
+            }
+        } else if ((c >= '0' && c <= '9') || c == '-') {
+            t->kind = T_NUMBER;
+            if (parseNumber(p, a->end, &p, &t->value) != YAS_OK) {
+                return fail(a, line, "bad number");
+            }
+            t->len = p - t->text;
+        } else {
+            switch (c) {
+                case '$': t->kind = T_DOLLAR; break;
+                case ',': t->kind = T_COMMA; break;
+                case '(': t->kind = T_LPAREN; break;
+                case ')': t->kind = T_RPAREN; break;
+                case ':': t->kind = T_COLON; break;
+                default:
+                    return fail(a, line, "unexpected character '%c'", c);
+            }
+            t->len = 1;
+            p++;
+        }
+        n++;
+    }
+
+    a->pos = p < a->end ? p + 1 : p;
+    a->line++;
+    return n;
+}
+
+// Parses an optional $ followed by a number or label into stmt
+static int parseValue(struct Assembler *a, struct Token *t, int n, int *i, struct Stmt *stmt) {
+    if (*i < n && t[*i].kind == T_DOLLAR) {
+        (*i)++;
+    }
+    if (*i < n && t[*i].kind == T_NUMBER) {
+        stmt->valC = t[*i].value;
+    } else if (*i < n && t[*i].kind == T_IDENT) {
+        // Only label references outlive the line, so only they are
+        // copied into the arena
+        struct Token *sym = arenaAlloc(a, sizeof(struct Token));
+
+        if (sym == NULL) {
+            return fail(a, t[*i].line, "out of memory");
+        }
+        *sym = t[*i];
+        stmt->sym = sym;
+    } else {
+        return fail(a, t[0].line, "expected a number or label");
+    }
+    (*i)++;
+    return YAS_OK;
+}
+
+static int parseRegister(struct Assembler *a, struct Token *t, int n, int *i, unsigned char *r) {
+    if (*i >= n || t[*i].kind != T_REG) {
+        return fail(a, t[0].line, "expected a register");
+    }
+    *r = (unsigned char) t[(*i)++].value;
+    return YAS_OK;
+}
+
+static int expect(struct Assembler *a, struct Token *t, int n, int *i, enum TokenKind kind, const char *what) {
+    if (*i >= n || t[*i].kind != kind) {
+        return fail(a, t[0].line, "expected %s", what);
+    }
+    (*i)++;
+    return YAS_OK;
+}
+
+// Parses D(rB), D or (rB)
+static int parseMemory(struct Assembler *a, struct Token *t, int n, int *i, struct Stmt *stmt) {
+    if (*i >= n) {
+        return fail(a, t[0].line, "expected a memory operand");
+    }
+    if (*i < n && t[*i].kind != T_LPAREN && parseValue(a, t, n, i, stmt) != YAS_OK) {
+        return YAS_INVALID;
+    }
+    if (*i < n && t[*i].kind == T_LPAREN) {
+        (*i)++;
+        if (parseRegister(a, t, n, i, &stmt->rB) != YAS_OK
+            || expect(a, t, n, i, T_RPAREN, "')'") != YAS_OK) {
+            return YAS_INVALID;
+        }
+    }
+    return YAS_OK;
+}
+
+static int lengthOf(const struct Stmt *stmt) {
+    switch (stmt->kind) {
+        case I_HALT:
+        case I_NOP:
+        case I_RET:
+        case S_BYTE:
+            return 1;
+        case I_RRMOVQ:
+        case I_OPQ:
+        case I_PUSHQ:
+        case I_POPQ:
+            return 2;
+        case I_JXX:
+        case I_CALL:
+            return 9;
+        case I_IRMOVQ:
+        case I_RMMOVQ:
+        case I_MRMOVQ:
+            return 10;
+        case S_QUAD:
+            return 8;
+    }
+    return 0;
+}
+
+/* Parses the statement in tokens t[i..n) into stmt.
+ *
+ * Returns YAS_OK or YAS_INVALID.
+ */
+static int parseStmt(struct Assembler *a, struct Token *t, int n, int i, struct Stmt *stmt) {
+    int res = YAS_OK;
+
+    stmt->rA = R_NONE;
+    stmt->rB = R_NONE;
+    stmt->iFn = 0;
+    stmt->valC = 0;
+    stmt->sym = NULL;
+
+    if (t[i].kind == T_DIRECTIVE) {
+        if (t[i].len == 5 && memcmp(t[i].text, ".quad", 5) == 0) {
+            stmt->kind = S_QUAD;
+        } else if (t[i].len == 5 && memcmp(t[i].text, ".byte", 5) == 0) {
+            stmt->kind = S_BYTE;
+        } else if (t[i].len == 4 && memcmp(t[i].text, ".pos", 4) == 0) {
+            stmt->kind = S_POS;
+        } else if (t[i].len == 6 && memcmp(t[i].text, ".align", 6) == 0) {
+            stmt->kind = S_ALIGN;
+        } else {
+            return fail(a, t[i].line, "unknown directive %.*s", (int) t[i].len, t[i].text);
+        }
+        i++;
+        res = parseValue(a, t, n, &i, stmt);
+        if (res == YAS_OK && stmt->kind != S_QUAD && stmt->sym != NULL) {
+            return fail(a, t[0].line, "%.*s needs a number", (int) t[i - 2].len, t[i - 2].text);
+        }
+        if (res == YAS_OK && stmt->kind == S_ALIGN
+            && (stmt->valC == 0 || (stmt->valC & (stmt->valC - 1)) != 0)) {
+            return fail(a, t[0].line, ".align needs a power of two");
+        }
+    } else if (t[i].kind == T_IDENT) {
+        const struct Mnemonic *m;
+
+        for (m = mnemonics; m->name != NULL; m++) {
+            if (m->len == t[i].len && memcmp(m->name, t[i].text, t[i].len) == 0) {
+                break;
+            }
+        }
+        if (m->name == NULL) {
+            return fail(a, t[i].line, "unknown instruction %.*s", (int) t[i].len, t[i].text);
+        }
+        stmt->kind = m->iCd;
+        stmt->iFn = m->iFn;
+        i++;
+
+        switch (m->iCd) {
+            case I_RRMOVQ:
+            case I_OPQ:
+                if (parseRegister(a, t, n, &i, &stmt->rA) != YAS_OK
+                    || expect(a, t, n, &i, T_COMMA, "','") != YAS_OK
+                    || parseRegister(a, t, n, &i, &stmt->rB) != YAS_OK) {
+                    return YAS_INVALID;
+                }
+                break;
+            case I_IRMOVQ:
+                if (parseValue(a, t, n, &i, stmt) != YAS_OK
+                    || expect(a, t, n, &i, T_COMMA, "','") != YAS_OK
+                    || parseRegister(a, t, n, &i, &stmt->rB) != YAS_OK) {
+                    return YAS_INVALID;
+                }
+                break;
+            case I_RMMOVQ:
+                if (parseRegister(a, t, n, &i, &stmt->rA) != YAS_OK
+                    || expect(a, t, n, &i, T_COMMA, "','") != YAS_OK
+                    || parseMemory(a, t, n, &i, stmt) != YAS_OK) {
+                    return YAS_INVALID;
+                }
+                break;
+            case I_MRMOVQ:
+                if (parseMemory(a, t, n, &i, stmt) != YAS_OK
+                    || expect(a, t, n, &i, T_COMMA, "','") != YAS_OK
+                    || parseRegister(a, t, n, &i, &stmt->rA) != YAS_OK) {
+                    return YAS_INVALID;
+                }
+                break;
+            case I_JXX:
+            case I_CALL:
+                res = parseValue(a, t, n, &i, stmt);
+                break;
+            case I_PUSHQ:
+            case I_POPQ:
+                res = parseRegister(a, t, n, &i, &stmt->rA);
+                break;
+        }
+    } else {
+        return fail(a, t[i].line, "expected an instruction or directive");
+    }
+
+    if (res == YAS_OK && i != n) {
+        return fail(a, t[i].line, "unexpected %.*s", (int) t[i].len, t[i].text);
+    }
+    return res;
+}
+
+// First pass: parse every line, assign addresses and define labels
+static int firstPass(struct Assembler *a, uint64_t *extent) {
+    uint64_t addr = 0;
+
+    *extent = 0;
+    while (a->pos < a->end) {
+        struct Token t[MAX_TOKENS];
+        struct Stmt *stmt;
+        int n = tokenizeLine(a, t);
+        int i = 0;
+
+        if (n < 0) {
+            return YAS_INVALID;
+        }
+        while (i + 1 < n && t[i].kind == T_IDENT && t[i + 1].kind == T_COLON) {
+            if (defineSymbol(a, &t[i], addr) != YAS_OK) {
+                return YAS_INVALID;
+            }
+            i += 2;
+        }
+        if (i == n) {
+            continue;
+        }
+
+        stmt = arenaAlloc(a, sizeof(struct Stmt));
+        if (stmt == NULL) {
+            return fail(a, t[0].line, "out of memory");
+        }
+        if (parseStmt(a, t, n, i, stmt) != YAS_OK) {
+            return YAS_INVALID;
+        }
+        if (stmt->kind == S_POS) {
+            addr = stmt->valC;
+        } else if (stmt->kind == S_ALIGN) {
+            if (addr > UINT64_MAX - (stmt->valC - 1)) {
+                return fail(a, t[0].line, "address overflows");
+            }
+            addr = (addr + stmt->valC - 1) & ~(stmt->valC - 1);
+        }
+        // The byte after the statement must still be addressable
+        if (UINT64_MAX - addr < (uint64_t) lengthOf(stmt)) {
+            return fail(a, t[0].line, "address overflows");
+        }
+        stmt->addr = addr;
+        stmt->line = t[0].line;
+        addr += lengthOf(stmt);
+        if (lengthOf(stmt) != 0 && addr > *extent) {
+            *extent = addr;
+        }
+
+        stmt->next = NULL;
+        if (a->last == NULL) {
+            a->first = stmt;
+        } else {
+            a->last->next = stmt;
+        }
+        a->last = stmt;
+    }
+    return YAS_OK;
+}
+
+// Second pass: resolve labels and encode every statement into image
+static int secondPass(struct Assembler *a, unsigned char *image, uint64_t extent) {
+    for (struct Stmt *stmt = a->first; stmt != NULL; stmt = stmt->next) {
+        unsigned char *p;
+        int length = lengthOf(stmt);
+        uint64_t valC = stmt->valC;
+
+        if (length == 0) {
+            continue;
+        }
+        if (stmt->addr > extent || extent - stmt->addr < (uint64_t) length) {
+            return fail(a, stmt->line, "statement outside the image");
+        }
+        p = image + stmt->addr;
+        if (stmt->sym != NULL) {
+            struct Symbol *sym = a->symbolCapacity == 0 ? NULL
+                : findSymbol(a, stmt->sym->text, stmt->sym->len);
+
+            if (sym == NULL || sym->name == NULL) {
+                return fail(a, stmt->sym->line, "undefined label %.*s",
+                            (int) stmt->sym->len, stmt->sym->text);
+            }
+            valC = sym->value;
+        }
+
+        if (stmt->kind == S_BYTE) {
+            p[0] = (unsigned char) valC;
+            continue;
+        }
+        if (stmt->kind != S_QUAD) {
+            *p++ = (unsigned char) (stmt->kind << 4 | stmt->iFn);
+            if (length == 2 || length == 10) {
+                *p++ = (unsigned char) (stmt->rA << 4 | stmt->rB);
+            }
+        }
+        if (length >= 8) {
+            for (int i = 0; i < 8; i++) {
+                *p++ = (unsigned char) (valC >> (i * 8));
+            }
+        }
+    }
+    return YAS_OK;
+}
+
+/* Assembles the len bytes of Y86-64 source in source. On success
+ * *image points to a malloc'd image, loaded at address 0, that runs up
+ * to the last byte emitted and *size holds its length. On failure a
+ * message is left in error (if errorSize is not 0).
+ *
+ * Returns YAS_OK or YAS_INVALID.
+ */
+int yasAssemble(const char *source, size_t len, unsigned char **image, size_t *size,
+                char *error, size_t errorSize) {
+    struct Assembler a;
+    uint64_t extent;
+    int res;
+
+    memset(&a, 0, sizeof(a));
+    a.src = source;
+    a.pos = source;
+    a.end = source + len;
+    a.line = 1;
+    a.error = error;
+    a.errorSize = errorSize;
+    *image = NULL;
+    *size = 0;
+
+    res = firstPass(&a, &extent);
+    if (res == YAS_OK && extent > SIZE_MAX) {
+        res = fail(&a, a.line, "image too large");
+    }
+    if (res == YAS_OK) {
+        *image = calloc(extent ? extent : 1, 1);
+        if (*image == NULL) {
+            res = fail(&a, a.line, "image of %llu bytes too large", (unsigned long long) extent);
+        }
+    }
+    if (res == YAS_OK) {
+        res = secondPass(&a, *image, extent);
+    }
+    if (res == YAS_OK) {
+        *size = extent;
+    } else {
+        free(*image);
+        *image = NULL;
+    }
+
+    free(a.symbols);
+    arenaFree(&a);
+    return res;
+}
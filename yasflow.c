@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "instructions.h"
+#include "yas.h"
+
+/* Register dataflow over decoded code. Each instruction's reads and
+ * writes fit in a 16 bit mask (one bit per register, with the unused
+ * slot 0xf standing for the condition codes), so every set operation
+ * below is a single word operation. Basic blocks are solved with a
+ * worklist: liveness backwards, and reaching definitions (which
+ * registers have a definition on some path) forwards. Each block can
+ * only grow its sets 16 times, and jump targets are found through a
+ * hash of the instruction addresses, so the whole analysis is linear
+ * in the number of instructions.
+ *
+ * Registers are assumed live wherever control leaves the decoded code
+ * (ret, halt, invalid bytes and unknown targets), so a write is only
+ * reported dead when every path overwrites it before reading it. Calls
+ * flow both into the callee and to the next instruction, and the
+ * callee is assumed to define every register by the time it returns.
+ */
+
+#define ALL_REGS ((uint16_t) 0xffff)
+#define NO_BLOCK ((size_t) -1)
+
+#define BLOCK_EXIT 1        // Control may leave the decoded code
+#define BLOCK_CALL 2        // Ends in a call, so succ[1] follows a return
+
+struct Block {
+    size_t first;
+    size_t last;
+    size_t succ[2];
+    int flags;
+    uint16_t gen;           // Upward exposed reads
+    uint16_t kill;          // Registers written
+    uint16_t liveIn;
+    uint16_t liveOut;
+    uint16_t defIn;         // Registers with a reaching definition
+    uint16_t defOut;
+    int queued;
+};
+
+static uint16_t bit(int r) {
+    return r == R_NONE ? 0 : (uint16_t) (1u << r);
+}
+
+// Fills in the registers (and condition codes) an instruction reads and writes
+static void useDef(const struct YasInstr *instr, uint16_t *use, uint16_t *def) {
+    uint16_t rsp = bit(R_RSP);
+
+    *use = 0;
+    *def = 0;
+    if (!instr->valid) {
+        return;
+    }
+    switch (instr->iCd) {
+        case I_RRMOVQ:
+            // A conditional move may leave rB alone, so it reads it too
+            *use = bit(instr->rA) | (instr->iFn == C_NC ? 0 : bit(instr->rB) | YAS_CC);
+            *def = bit(instr->rB);
+            break;
+        case I_IRMOVQ:
+            *def = bit(instr->rB);
+            break;
+        case I_RMMOVQ:
+            *use = bit(instr->rA) | bit(instr->rB);
+            break;
+        case I_MRMOVQ:
+            *use = bit(instr->rB);
+            *def = bit(instr->rA);
+            break;
+        case I_OPQ:
+            // xorq and subq of a register with itself only clear it
+            if (instr->rA != instr->rB || (instr->iFn != A_XORQ && instr->iFn != A_SUBQ)) {
+                *use = bit(instr->rA) | bit(instr->rB);
+            }
+            *def = bit(instr->rB) | YAS_CC;
+            break;
+        case I_JXX:
+            *use = instr->iFn == C_NC ? 0 : YAS_CC;
+            break;
+        case I_CALL:
+        case I_RET:
+            *use = rsp;
+            *def = rsp;
+            break;
+        case I_PUSHQ:
+            *use = bit(instr->rA) | rsp;
+            *def = rsp;
+            break;
+        case I_POPQ:
+            *use = rsp;
+            *def = bit(instr->rA) | rsp;
+            break;
+    }
+}
+
+static int endsBlock(const struct YasInstr *instr) {
+    return !instr->valid || instr->iCd == I_JXX || instr->iCd == I_CALL
+        || instr->iCd == I_RET || instr->iCd == I_HALT;
+}
+
+// Returns the slot of the address hash that holds addr, or the empty slot where it would go
+static size_t addrSlot(const struct YasInstr *instrs, const size_t *slots, size_t mask, uint64_t addr) {
+    size_t i = (size_t) (addr * 0x9E3779B97F4A7C15ull >> 32) & mask;
+
+    while (slots[i] != NO_BLOCK && instrs[slots[i]].addr != addr) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Analyses the n decoded instructions in instrs, which must be in
+ * address order (as yasDecodeBuffer() produces them), filling in one
+ * entry of flow per instruction.
+ *
+ * Returns YAS_OK, or YAS_ERROR if memory could not be allocated.
+ */
+int yasAnalyze(const struct YasInstr *instrs, size_t n, struct YasFlow *flow) {
+    struct Block *blocks = NULL;
+    size_t *blockOf = NULL;
+    size_t *preds = NULL;
+    size_t *predStart = NULL;
+    size_t *worklist = NULL;
+    size_t *slots = NULL;
+    size_t slotCount = 64;
+    size_t blockCount = 0;
+    size_t top;
+    int res = YAS_ERROR;
+
+    if (n == 0) {
+        return YAS_OK;
+    }
+
+    // Hash every instruction by address, at most half full, so each
+    // jump or call target is found in constant expected time
+    while (slotCount / 2 < n) {
+        if (slotCount > SIZE_MAX / 2 / sizeof(size_t)) {
+            return YAS_ERROR;
+        }
+        slotCount *= 2;
+    }
+    slots = malloc(slotCount * sizeof(size_t));
+    if (slots == NULL) {
+        return YAS_ERROR;
+    }
+    for (size_t j = 0; j < slotCount; j++) {
+        slots[j] = NO_BLOCK;
+    }
+
+    // Mark the leaders: the first instruction, jump and call targets
+    // and whatever follows the end of a block
+    for (size_t i = 0; i < n; i++) {
+        size_t slot = addrSlot(instrs, slots, slotCount - 1, instrs[i].addr);
+
+        memset(&flow[i], 0, sizeof(flow[i]));
+        useDef(&instrs[i], &flow[i].use, &flow[i].def);
+        if (slots[slot] == NO_BLOCK) {
+            slots[slot] = i;
+        }
+    }
+    flow[0].leader = 1;
+    for (size_t i = 0; i < n; i++) {
+        if (endsBlock(&instrs[i]) && i + 1 < n) {
+            flow[i + 1].leader = 1;
+        }
+        flow[i].target = NO_BLOCK;
+        if (instrs[i].valid && (instrs[i].iCd == I_JXX || instrs[i].iCd == I_CALL)) {
+            size_t target = slots[addrSlot(instrs, slots, slotCount - 1, instrs[i].valC)];
+
+            if (target != NO_BLOCK) {
+                flow[i].target = target;
+                flow[target].leader = 1;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        blockCount += flow[i].leader;
+    }
+    blocks = calloc(blockCount, sizeof(struct Block));
+    blockOf = malloc(n * sizeof(size_t));
+    predStart = calloc(blockCount + 1, sizeof(size_t));
+    preds = malloc(2 * blockCount * sizeof(size_t));
+    worklist = malloc(blockCount * sizeof(size_t));
+    if (blocks == NULL || blockOf == NULL || predStart == NULL || preds == NULL || worklist == NULL) {
+        goto done;
+    }
+
+    // Build the blocks and their local summaries
+    for (size_t i = 0, b = NO_BLOCK; i < n; i++) {
+        if (flow[i].leader) {
+            b = b == NO_BLOCK ? 0 : b + 1;
+            blocks[b].first = i;
+        }
+        blocks[b].last = i;
+        blockOf[i] = b;
+    }
+    for (size_t b = 0; b < blockCount; b++) {
+        struct Block *blk = &blocks[b];
+        const struct YasInstr *end = &instrs[blk->last];
+        size_t next = blk->last + 1 < n ? b + 1 : NO_BLOCK;
+        size_t target = flow[blk->last].target;
+
+        blk->succ[0] = NO_BLOCK;
+        blk->succ[1] = NO_BLOCK;
+        if (!end->valid || end->iCd == I_RET || end->iCd == I_HALT) {
+            blk->flags = BLOCK_EXIT;
+        } else if (end->iCd == I_JXX || end->iCd == I_CALL) {
+            blk->succ[0] = target == NO_BLOCK ? NO_BLOCK : blockOf[target];
+            if (target == NO_BLOCK) {
+                blk->flags |= BLOCK_EXIT;
+            }
+            if (end->iCd == I_CALL) {
+                blk->flags |= BLOCK_CALL;
+            }
+            if (!(end->iCd == I_JXX && end->iFn == C_NC)) {
+                blk->succ[1] = next;
+            }
+        } else {
+            blk->succ[1] = next;
+        }
+        if (blk->succ[1] == NO_BLOCK && !(end->iCd == I_JXX && end->iFn == C_NC)
+            && !(blk->flags & BLOCK_EXIT)) {
+            // Falls off the end of the decoded code
+            blk->flags |= BLOCK_EXIT;
+        }
+
+        for (size_t i = blk->last + 1; i-- > blk->first; ) {
+            blk->gen = (blk->gen & ~flow[i].def) | flow[i].use;
+            blk->kill |= flow[i].def;
+        }
+    }
+
+    // Predecessor lists, stored compressed
+    for (size_t b = 0; b < blockCount; b++) {
+        for (int s = 0; s < 2; s++) {
+            if (blocks[b].succ[s] != NO_BLOCK) {
+                predStart[blocks[b].succ[s] + 1]++;
+            }
+        }
+    }
+    for (size_t b = 0; b < blockCount; b++) {
+        predStart[b + 1] += predStart[b];
+    }
+    // The worklist doubles as the fill cursor for each block's list
+    for (size_t b = 0; b < blockCount; b++) {
+        worklist[b] = predStart[b];
+    }
+    for (size_t b = 0; b < blockCount; b++) {
+        for (int s = 0; s < 2; s++) {
+            if (blocks[b].succ[s] != NO_BLOCK) {
+                preds[worklist[blocks[b].succ[s]]++] = b;
+            }
+        }
+    }
+
+    // Liveness, backwards. Blocks are queued last to first so most
+    // are visited after their successors.
+    top = 0;
+    for (size_t b = 0; b < blockCount; b++) {
+        worklist[top++] = b;
+        blocks[b].queued = 1;
+    }
+    while (top != 0) {
+        struct Block *blk = &blocks[worklist[--top]];
+        uint16_t out = blk->flags & BLOCK_EXIT ? ALL_REGS : 0;
+        uint16_t in;
+
+        blk->queued = 0;
+        for (int s = 0; s < 2; s++) {
+            if (blk->succ[s] != NO_BLOCK) {
+                out |= blocks[blk->succ[s]].liveIn;
+            }
+        }
+        blk->liveOut = out;
+        in = blk->gen | (out & ~blk->kill);
+        if (in != blk->liveIn) {
+            size_t b = blk - blocks;
+
+            blk->liveIn = in;
+            for (size_t p = predStart[b]; p < predStart[b + 1]; p++) {
+                if (!blocks[preds[p]].queued) {
+                    blocks[preds[p]].queued = 1;
+                    worklist[top++] = preds[p];
+                }
+            }
+        }
+    }
+
+    // Reaching definitions, forwards from blocks nothing jumps to
+    top = 0;
+    for (size_t b = blockCount; b-- > 0; ) {
+        worklist[top++] = b;
+        blocks[b].queued = 1;
+    }
+    while (top != 0) {
+        size_t b = worklist[--top];
+        struct Block *blk = &blocks[b];
+        uint16_t out;
+
+        blk->queued = 0;
+        out = blk->defIn | blk->kill;
+        blk->defOut = out;
+        for (int s = 0; s < 2; s++) {
+            size_t succ = blk->succ[s];
+            uint16_t reach = s == 1 && (blk->flags & BLOCK_CALL) ? ALL_REGS : out;
+
+            if (succ != NO_BLOCK && (blocks[succ].defIn | reach) != blocks[succ].defIn) {
+                blocks[succ].defIn |= reach;
+                if (!blocks[succ].queued) {
+                    blocks[succ].queued = 1;
+                    worklist[top++] = succ;
+                }
+            }
+        }
+    }
+
+    // Push the block results down to the instructions
+    for (size_t b = 0; b < blockCount; b++) {
+        uint16_t live = blocks[b].liveOut;
+        uint16_t defined = blocks[b].defIn;
+
+        for (size_t i = blocks[b].last + 1; i-- > blocks[b].first; ) {
+            flow[i].liveOut = live;
+            flow[i].dead = flow[i].def & ~live & ~YAS_CC;
+            live = (live & ~flow[i].def) | flow[i].use;
+            flow[i].liveIn = live;
+        }
+        for (size_t i = blocks[b].first; i <= blocks[b].last; i++) {
+            flow[i].undefined = flow[i].use & ~defined & ~YAS_CC;
+            defined |= flow[i].def;
+        }
+    }
+    res = YAS_OK;
+
+done:
+    free(blocks);
+    free(blockOf);
+    free(predStart);
+    free(preds);
+    free(worklist);
+    free(slots);
+    return res;
+}
+
+/* Formats mask as a space separated list of register names, with cc
+ * for the condition codes.
+ *
+ * Returns the length of the list, or YAS_ERROR if it did not fit.
+ */
+int yasFormatMask(uint16_t mask, char *out, size_t size) {
+    size_t len = 0;
+
+    if (size == 0) {
+        return YAS_ERROR;
+    }
+    out[0] = '\0';
+    for (int r = 0; r < 16; r++) {
+        const char *name = r == R_NONE ? "cc" : yasRegisterName(r);
+        size_t nameLen = strlen(name);
+
+        if (!(mask & (1u << r))) {
+            continue;
+        }
+        if (len + (len != 0) + nameLen >= size) {
+            return YAS_ERROR;
+        }
+        if (len != 0) {
+            out[len++] = ' ';
+        }
+        memcpy(out + len, name, nameLen + 1);
+        len += nameLen;
+    }
+    return (int) len;
+}